@@ -1,12 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <memory>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <variant>
 #include "types.hpp"
 #include "name.hpp"
+#include "interned_map.hpp"
 
 namespace eosio {
 
@@ -20,7 +24,8 @@ enum class abi_error {
    redefined_type,
    base_not_a_struct,
    extension_typedef,
-   bad_abi
+   bad_abi,
+   bad_abi_image
 };
 
 constexpr inline std::string_view convert_abi_error(eosio::abi_error e) {
@@ -34,6 +39,7 @@ constexpr inline std::string_view convert_abi_error(eosio::abi_error e) {
       case abi_error::base_not_a_struct: return "Base not a struct";
       case abi_error::extension_typedef: return "Extension typedef";
       case abi_error::bad_abi: return "Bad ABI";
+      case abi_error::bad_abi_image: return "Bad ABI image";
       default: return "internal failure";
    };
 }
@@ -142,12 +148,49 @@ EOSIO_REFLECT(abi_def, version, types, structs, actions, tables, ricardian_claus
 struct abi_type;
 
 struct abi_field {
-    std::string name;
+    // Interned in the abi's abi_types, or a string literal
+    std::string_view name;
     const abi_type* type;
+    // The json which introduces the field, with the name escaped: ,"name": in a struct, or ["name",
+    // in a variant. Interned like name; bin_to_json writes it with one copy.
+    std::string_view json_key;
+};
+
+// Returns before, name as a json string, then after; see abi_field::json_key
+std::string json_key(char before, std::string_view name, char after);
+
+// Instructions of abi_type::bin_to_json_program; abieos::bin_to_json interprets them
+enum class bin_to_json_opcode : uint8_t {
+    // Read and write a builtin. Same order as the builtins in abi.cpp
+    bool_, int8, uint8, int16, uint16, int32, uint32, int64, uint64, int128, uint128, varuint32, varint32, float32,
+    float64, float128, time_point, time_point_sec, block_timestamp, name, bytes, string, checksum160, checksum256,
+    checksum512, public_key, private_key, signature, symbol, symbol_code, asset,
+
+    optional,     // Read a flag. If it's clear, write null and skip arg instructions
+    call,         // Run type's program
+    begin_object, // Write {
+    first_field,  // Write field's key, or skip arg instructions if field is a missing extension
+    field,        // Same as first_field, but write a comma first
+    end_object,   // Write } and return
+    begin_array,  // Read the array size and write [
+    array_item,   // Jump by arg if there are no more items, otherwise write a comma if this isn't the first
+    end_array,    // Write ] and return
+    variant,      // Write [, read the index, write type's alternative name, then skip index instructions
+    jump,         // Jump by arg
+    end_variant,  // Write ] and return
+    ret,          // Return
+};
+
+struct bin_to_json_op {
+    bin_to_json_opcode code{};
+    bool keep_allow_extensions = false; // call: whether the called type may end with missing extensions
+    int32_t arg = 0;
+    const abi_type* type = nullptr;
+    const abi_field* field = nullptr;
 };
 
 struct abi_type {
-    std::string name;
+    std::string_view name;
 
     struct builtin {};
     using alias_def = std::string;
@@ -163,9 +206,38 @@ struct abi_type {
     std::variant<builtin, const alias_def*, const struct_def*, const variant_def*, alias, optional, extension, array, struct_, variant> _data;
     const abi_serializer* ser = nullptr;
 
+    // Flat version of ser->bin_to_json. Empty if the type hasn't been compiled; ser handles those.
+    std::vector<bin_to_json_op> bin_to_json_program;
+
+    // Bounds on the size of the binary form, known once the type is compiled. They're equal for
+    // fixed-size types.
+    static constexpr uint32_t unbounded_bin_size = 0xffff'ffff;
+    uint32_t min_bin_size = 0;
+    uint32_t max_bin_size = unbounded_bin_size;
+    bool bin_size_known = false;
+
+    // Shape of the json form, known once the type is compiled: the json size of a typical smallest
+    // value, and roughly how many json bytes each binary byte past min_bin_size becomes.
+    uint32_t min_json_size = 0;
+    float json_per_extra_bin_byte = 2;
+
+    // Estimated json size of a value whose binary form is bin_size bytes. It's only a hint for
+    // reserving output, so it's capped to keep odd shapes from reserving far more than they use.
+    size_t estimate_json_size(size_t bin_size) const {
+       size_t extra = bin_size > min_bin_size ? bin_size - min_bin_size : 0;
+       return std::min(min_json_size + size_t(extra * std::min(json_per_extra_bin_byte, 4.0f)), bin_size * 8 + 64);
+    }
+
+    // Set once the type and every type it refers to are resolved and compiled
+    bool closed = false;
+
+    // A variant's alternatives by name, built when the type is compiled. If names repeat, the
+    // first alternative wins.
+    flat_string_index alternative_index;
+
     template<typename T>
-    abi_type(std::string name, T&& arg, const abi_serializer* ser)
-        : name(std::move(name)), _data(std::forward<T>(arg)), ser(ser) {}
+    abi_type(std::string_view name, T&& arg, const abi_serializer* ser)
+        : name(name), _data(std::forward<T>(arg)), ser(ser) {}
     abi_type(const abi_type&) = delete;
     abi_type& operator=(const abi_type&) = delete;
 
@@ -189,6 +261,28 @@ struct abi_type {
        return std::get_if<variant>(&_data);
     }
 
+    // Rebuilds alternative_index from the variant's alternatives
+    void index_alternatives() {
+       alternative_index = {};
+       auto* v = as_variant();
+       if (!v)
+          return;
+       for (uint32_t i = 0; i < v->size(); ++i) {
+          auto name = (*v)[i].name;
+          auto h    = flat_string_index::hash(name);
+          if (alternative_index.find(name, h, [&](uint32_t j) { return (*v)[j].name; }) == flat_string_index::npos)
+             alternative_index.insert(h, i);
+       }
+    }
+
+    // Returns the variant's alternative named alternative, or nullptr
+    const abi_field* find_alternative(std::string_view alternative) const {
+       auto& v   = *as_variant();
+       auto  pos = alternative_index.find(alternative, flat_string_index::hash(alternative),
+                                          [&](uint32_t i) { return v[i].name; });
+       return pos == flat_string_index::npos ? nullptr : &v[pos];
+    }
+
     std::string bin_to_json(input_stream& bin, std::function<void()> f = []{}) const;
     std::vector<char> json_to_bin(std::string_view json, std::function<void()> f = []{}) const;
     std::vector<char> json_to_bin_reorderable(std::string_view json, std::function<void()> f = []{}) const;
@@ -197,9 +291,22 @@ struct abi_type {
 struct abi {
     std::map<eosio::name, std::string> action_types;
     std::map<eosio::name, std::string> table_types;
-    std::map<std::string, abi_type> abi_types;
+    interned_map<abi_type> abi_types;
+    // action_types and table_types resolved by convert, keyed by name value. Entries whose
+    // types don't resolve are left out.
+    std::unordered_map<uint64_t, const abi_type*> resolved_action_types;
+    std::unordered_map<uint64_t, const abi_type*> resolved_table_types;
+    // Keeps types shared with an earlier version of this abi alive
+    std::shared_ptr<const abi> previous;
+    // Set by convert_lazy. Unresolved types point into it.
+    std::shared_ptr<const abi_def> lazy_def;
     const abi_type* get_type(const std::string& name);
 
+    // Looks up a type without modifying the abi. Returns nullptr if the type
+    // is missing or has not been resolved yet (e.g. "x[]" was never used, or
+    // a lazy abi hasn't reached it).
+    const abi_type* find_type(std::string_view name) const;
+
     // Adds a type to the abi.  Has no effect if the type is already present.
     // If the type is a struct, all members will be added recursively.
     // Exception Safety: basic. If add_type fails, some objects may have
@@ -209,8 +316,23 @@ struct abi {
 };
 
 void convert(const abi_def& def, abi&);
+// Like convert(def, c), but types whose definitions (including everything they refer to)
+// are unchanged from prev_def are shared with prev instead of being resolved again.
+void convert(const abi_def& def, abi& c, const abi_def& prev_def, std::shared_ptr<const abi> prev);
+// Like convert, but only checks type names up front. A type and everything it refers to are
+// resolved and compiled the first time get_type reaches it, so errors in types which are
+// never used aren't reported. c keeps def alive.
+void convert_lazy(std::shared_ptr<const abi_def> def, abi& c);
+void convert_lazy(std::shared_ptr<const abi_def> def, abi& c, const abi_def& prev_def,
+                  std::shared_ptr<const abi> prev);
 void convert(const abi& def, abi_def&);
 
+// Writes the resolved types of an abi, along with its actions and tables, as a position-independent image
+void save_image(const abi& a, std::vector<char>& image);
+// Fills an empty abi from an image written by save_image. The image may be memory-mapped; it's no longer
+// needed once load_image returns.
+void load_image(abi& c, std::string_view image);
+
 extern const abi_serializer* const object_abi_serializer;
 extern const abi_serializer* const variant_abi_serializer;
 extern const abi_serializer* const array_abi_serializer;
@@ -220,13 +342,13 @@ extern const abi_serializer* const optional_abi_serializer;
 template<typename T>
 auto add_type(abi& a, T*) -> std::enable_if_t<reflection::has_for_each_field_v<T>, abi_type*> {
    std::string name = get_type_name((T*)nullptr);
-   auto [iter, inserted] = a.abi_types.try_emplace(name, name, abi_type::struct_{}, object_abi_serializer);
+   auto [iter, inserted] = a.abi_types.try_emplace(name, abi_type::struct_{}, object_abi_serializer);
    if(!inserted)
       return &iter->second;
    auto& s = std::get<abi_type::struct_>(iter->second._data);
    for_each_field<T>([&](const char* name, auto&& member){
       auto member_type = a.add_type<std::decay_t<decltype(member((T*)nullptr))>>();
-      s.fields.push_back({name, member_type});
+      s.fields.push_back({name, member_type, a.abi_types.intern(json_key(',', name, ':'))});
    });
    return &iter->second;
 }
@@ -245,7 +367,7 @@ abi_type* add_type(abi& a, std::vector<T>*) {
    check(!(element_type->optional_of() || element_type->array_of() || element_type->extension_of()),
       convert_abi_error(abi_error::invalid_nesting));
    std::string name = get_type_name((std::vector<T>*)nullptr);
-   auto [iter, inserted] = a.abi_types.try_emplace(name, name, abi_type::array{element_type}, array_abi_serializer);
+   auto [iter, inserted] = a.abi_types.try_emplace(name, abi_type::array{element_type}, array_abi_serializer);
    return &iter->second;
 }
 
@@ -254,11 +376,13 @@ abi_type* add_type(abi& a, std::variant<T...>*) {
    abi_type::variant types;
    ([&](auto* t) {
       auto type = add_type(a, t);
-      types.push_back({type->name, type});
+      types.push_back({type->name, type, a.abi_types.intern(json_key('[', type->name, ','))});
    }((T*)nullptr), ...);
    std::string name = get_type_name((std::variant<T...>*)nullptr);
 
-   auto [iter, inserted] = a.abi_types.try_emplace(name, name, std::move(types), variant_abi_serializer);
+   auto [iter, inserted] = a.abi_types.try_emplace(name, std::move(types), variant_abi_serializer);
+   if (inserted)
+      iter->second.index_alternatives();
    return &iter->second;
 }
 
@@ -268,7 +392,7 @@ abi_type* add_type(abi& a, std::optional<T>*) {
    check(!(element_type->optional_of() || element_type->array_of() || element_type->extension_of()),
       convert_abi_error(abi_error::invalid_nesting));
    std::string name = get_type_name((std::optional<T>*)nullptr);
-   auto [iter, inserted] = a.abi_types.try_emplace(name, name, abi_type::optional{element_type}, optional_abi_serializer);
+   auto [iter, inserted] = a.abi_types.try_emplace(name, abi_type::optional{element_type}, optional_abi_serializer);
    return &iter->second;
 }
 
@@ -277,8 +401,8 @@ abi_type* add_type(abi& a, might_not_exist<T>*) {
    auto element_type = a.add_type<T>();
    check(!element_type->extension_of(),
       convert_abi_error(abi_error::invalid_nesting));
-   std::string name = element_type->name + "$";
-   auto [iter, inserted] = a.abi_types.try_emplace(name, name, abi_type::extension{element_type}, extension_abi_serializer);
+   std::string name = std::string{element_type->name} + "$";
+   auto [iter, inserted] = a.abi_types.try_emplace(name, abi_type::extension{element_type}, extension_abi_serializer);
    return &iter->second;
 }
 
@@ -10,8 +10,26 @@ extern "C" {
 #endif
 
 typedef struct abieos_context_s abieos_context;
+typedef struct abieos_registry_s abieos_registry;
+typedef struct abieos_type_s abieos_type;
 typedef int abieos_bool;
 
+// An input to abieos_bin_to_json_batch. type is ignored if handle isn't null.
+typedef struct abieos_bin_item {
+    uint64_t contract;
+    const char* type;
+    const abieos_type* handle;
+    const char* data;
+    size_t size;
+} abieos_bin_item;
+
+// An input to abieos_registry_set_abis_bin
+typedef struct abieos_abi_item {
+    uint64_t contract;
+    const char* data;
+    size_t size;
+} abieos_abi_item;
+
 // Create a context. The context holds all memory allocated by functions in this header. Returns null on failure.
 abieos_context* abieos_create();
 
@@ -44,12 +62,71 @@ abieos_bool abieos_set_abi_bin(abieos_context* context, uint64_t contract, const
 // Set abi (hex format). Returns false on error.
 abieos_bool abieos_set_abi_hex(abieos_context* context, uint64_t contract, const char* hex);
 
-// Get the type name for an action. The contract owns the returned memory. Returns null on error; use abieos_get_error
-// to retrieve error.
+// Set the abi which a contract uses from block_num onward (JSON format). Replaces any abi previously set for the same
+// block. abieos_set_abi* set the abi for block 0. Returns false on error.
+abieos_bool abieos_set_abi_at_block(abieos_context* context, uint64_t contract, uint32_t block_num, const char* abi);
+
+// Set the abi which a contract uses from block_num onward (binary format). Returns false on error.
+abieos_bool abieos_set_abi_bin_at_block(abieos_context* context, uint64_t contract, uint32_t block_num,
+                                        const char* data, size_t size);
+
+// Set the abi which a contract uses from block_num onward (hex format). Returns false on error.
+abieos_bool abieos_set_abi_hex_at_block(abieos_context* context, uint64_t contract, uint32_t block_num,
+                                        const char* hex);
+
+// Set abi from an image made by abieos_save_abi_image. An image holds resolved types, so this skips parsing and
+// resolving the abi; data may point into a memory-mapped file and isn't used after this returns. Images hold integers
+// in the byte order of the machine which saved them, and only load on machines with the same order. Returns false on
+// error.
+abieos_bool abieos_set_abi_image(abieos_context* context, uint64_t contract, const char* data, size_t size);
+
+// Save the abi which a contract uses as an image. Use abieos_get_bin_size and abieos_get_bin_data to retrieve it. Types
+// which a lazy abi can't resolve are left out. Returns false on error.
+abieos_bool abieos_save_abi_image(abieos_context* context, uint64_t contract);
+
+// Select the block whose abis later calls use. Defaults to the latest abis. Returns false on error.
+abieos_bool abieos_set_block_num(abieos_context* context, uint32_t block_num);
+
+// Choose whether abis which this context sets from now on, including ones it adds to a registry, resolve each type
+// on first use instead of up front. Lazy abis load faster, but report errors in a type only when it's used. Returns
+// false on error.
+abieos_bool abieos_set_lazy_abis(abieos_context* context, abieos_bool lazy);
+
+// Create a registry. A registry holds abis which many contexts, including contexts owned by other threads, may
+// share. Returns null on failure.
+abieos_registry* abieos_registry_create();
+
+// Release a registry. Contexts which are attached to the registry keep it alive until they detach or are destroyed.
+void abieos_registry_destroy(abieos_registry* registry);
+
+// Set abi in a registry (JSON format). Replaces any previous abi for the contract; conversions already in progress
+// keep using the abi they started with. Errors are reported through context. Returns false on error.
+abieos_bool abieos_registry_set_abi(abieos_context* context, abieos_registry* registry, uint64_t contract,
+                                    const char* abi);
+
+// Set abi in a registry (binary format). Returns false on error.
+abieos_bool abieos_registry_set_abi_bin(abieos_context* context, abieos_registry* registry, uint64_t contract,
+                                        const char* data, size_t size);
+
+// Set several abis in a registry (binary format). They replace the previous abis together, which is much faster than
+// setting many contracts one at a time. If any abi fails to load, none are set. Returns false on error.
+abieos_bool abieos_registry_set_abis_bin(abieos_context* context, abieos_registry* registry,
+                                         const abieos_abi_item* items, size_t count);
+
+// Set abi in a registry (hex format). Returns false on error.
+abieos_bool abieos_registry_set_abi_hex(abieos_context* context, abieos_registry* registry, uint64_t contract,
+                                        const char* hex);
+
+// Attach a registry to a context, or detach it if registry is null. Abis set directly on the context take precedence
+// over the registry. Returns false on error.
+abieos_bool abieos_set_registry(abieos_context* context, abieos_registry* registry);
+
+// Get the type name for an action. The contract's abi owns the returned string, which stays valid until that abi is
+// replaced. Returns null on error; use abieos_get_error to retrieve error.
 const char* abieos_get_type_for_action(abieos_context* context, uint64_t contract, uint64_t action);
 
-// Get the type name for a table. The contract owns the returned memory. Returns null on error; use abieos_get_error
-// to retrieve error.
+// Get the type name for a table. The contract's abi owns the returned string, which stays valid until that abi is
+// replaced. Returns null on error; use abieos_get_error to retrieve error.
 const char* abieos_get_type_for_table(abieos_context* context, uint64_t contract, uint64_t table);
 
 // Convert json to binary. Use abieos_get_bin_* to retrieve result. Returns false on error.
@@ -64,6 +141,59 @@ abieos_bool abieos_json_to_bin_reorderable(abieos_context* context, uint64_t con
 const char* abieos_bin_to_json(abieos_context* context, uint64_t contract, const char* type, const char* data,
                                size_t size);
 
+// Get a handle to a contract's type, for use with the *_with_handle functions. The handle stays valid until the
+// context is destroyed and keeps using the abi it came from, even if the contract's abi changes. Returns null on
+// error; use abieos_get_error to retrieve error.
+const abieos_type* abieos_get_type_handle(abieos_context* context, uint64_t contract, const char* type);
+
+// Convert json to binary. Use abieos_get_bin_* to retrieve result. Returns false on error.
+abieos_bool abieos_json_to_bin_with_handle(abieos_context* context, const abieos_type* type, const char* json);
+
+// Convert json to binary. Allow json field reordering. Use abieos_get_bin_* to retrieve result. Returns false on error.
+abieos_bool abieos_json_to_bin_reorderable_with_handle(abieos_context* context, const abieos_type* type,
+                                                       const char* json);
+
+// Convert binary to json. The context owns the returned string. Returns null on error; use abieos_get_error to retrieve
+// error.
+const char* abieos_bin_to_json_with_handle(abieos_context* context, const abieos_type* type, const char* data,
+                                           size_t size);
+
+// Convert json to binary, writing the result to buf and its size to *result_size. If *result_size is larger than
+// buf_size, buf's contents are unspecified; call again with a buffer of at least that size. Returns false on error.
+abieos_bool abieos_json_to_bin_buffer(abieos_context* context, const abieos_type* type, const char* json, char* buf,
+                                      size_t buf_size, size_t* result_size);
+
+// Convert json to binary without copying json. json must be NUL-terminated at json[size]; it is converted in place,
+// so its contents are unspecified afterwards. Use abieos_get_bin_* to retrieve result. Returns false on error.
+abieos_bool abieos_json_to_bin_in_situ(abieos_context* context, const abieos_type* type, char* json, size_t size);
+
+// Convert binary to json, writing the NUL-terminated result to buf and its size, including the NUL, to *result_size.
+// If *result_size is larger than buf_size, buf's contents are unspecified; call again with a buffer of at least that
+// size. Returns false on error.
+abieos_bool abieos_bin_to_json_buffer(abieos_context* context, const abieos_type* type, const char* data, size_t size,
+                                      char* buf, size_t buf_size, size_t* result_size);
+
+// Convert an action's binary data to json. The context owns the returned string. Returns null on error; use
+// abieos_get_error to retrieve error.
+const char* abieos_action_bin_to_json(abieos_context* context, uint64_t contract, uint64_t action, const char* data,
+                                      size_t size);
+
+// Convert a table row's binary data to json. The context owns the returned string. Returns null on error; use
+// abieos_get_error to retrieve error.
+const char* abieos_table_bin_to_json(abieos_context* context, uint64_t contract, uint64_t table, const char* data,
+                                     size_t size);
+
+// Convert count binary values to json. The results are stored one after another, each NUL-terminated, in a buffer
+// which the context owns; result i starts at offsets[i] in the returned buffer. ok[i] is false if item i failed, in
+// which case result i is its error message. Returns null if the call itself fails; use abieos_get_error to retrieve
+// error.
+const char* abieos_bin_to_json_batch(abieos_context* context, const abieos_bin_item* items, size_t count,
+                                     size_t* offsets, abieos_bool* ok);
+
+// Set how many threads abieos_bin_to_json_batch uses, including the calling thread. The context owns the threads.
+// Results are the same as with one thread. Returns false on error.
+abieos_bool abieos_set_threads(abieos_context* context, uint32_t num_threads);
+
 // Convert hex to json. The context owns the returned memory. Returns null on error; use abieos_get_error to retrieve
 // error.
 const char* abieos_hex_to_json(abieos_context* context, uint64_t contract, const char* type, const char* hex);
@@ -344,7 +344,8 @@ inline void from_string(asset& result, S& stream) {
 
 template <typename S>
 void to_json(const asset& obj, S& stream) {
-   to_json(asset_to_string(obj.amount, obj.symbol.value), stream);
+   char buf[max_asset_chars];
+   to_json(std::string_view{ buf, asset_to_chars(obj.amount, obj.symbol.value, buf) }, stream);
 }
 
 template <typename S>
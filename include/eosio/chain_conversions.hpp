@@ -2,6 +2,7 @@
 
 #include "stream.hpp"
 #include <chrono>
+#include <cstring>
 #include <stdint.h>
 #include <string>
 #include <string_view>
@@ -213,19 +214,25 @@ constexpr inline uint64_t string_to_name_strict(std::string_view str) {
    __builtin_unreachable();
 }
 
-inline std::string name_to_string(uint64_t name) {
-   static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
-   std::string        str(13, '.');
-
-   uint64_t tmp = name;
-   for (uint32_t i = 0; i <= 12; ++i) {
-      char c      = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
-      str[12 - i] = c;
-      tmp >>= (i == 0 ? 4 : 5);
+inline constexpr char   name_charmap[]  = ".12345abcdefghijklmnopqrstuvwxyz";
+inline constexpr size_t max_name_chars = 13;
+
+// Writes name's characters to dest, which needs room for max_name_chars. Returns how many it wrote.
+// Names never need json escaping.
+inline size_t name_to_chars(uint64_t name, char* dest) {
+   dest[12] = name_charmap[name & 0x0f];
+   for (int i = 11; i >= 0; --i) {
+      name >>= i == 11 ? 4 : 5;
+      dest[i] = name_charmap[name & 0x1f];
    }
+   size_t size = max_name_chars;
+   while (size && dest[size - 1] == '.') --size;
+   return size;
+}
 
-   const auto last = str.find_last_not_of('.');
-   return str.substr(0, last + 1);
+inline std::string name_to_string(uint64_t name) {
+   char buf[max_name_chars];
+   return { buf, name_to_chars(name, buf) };
 }
 
 inline std::string microseconds_to_str(uint64_t microseconds) {
@@ -349,13 +356,22 @@ inline std::string microseconds_to_str(uint64_t microseconds) {
    return string_to_symbol_code(result, pos, end, true);
 }
 
-inline std::string symbol_code_to_string(uint64_t v) {
-   std::string result;
+inline constexpr size_t max_symbol_code_chars = 8;
+
+// Writes the symbol code's characters to dest, which needs room for max_symbol_code_chars. Returns
+// how many it wrote.
+inline size_t symbol_code_to_chars(uint64_t v, char* dest) {
+   size_t size = 0;
    while (v > 0) {
-      result += char(v & 0xFF);
+      dest[size++] = char(v & 0xFF);
       v >>= 8;
    }
-   return result;
+   return size;
+}
+
+inline std::string symbol_code_to_string(uint64_t v) {
+   char buf[max_symbol_code_chars];
+   return { buf, symbol_code_to_chars(v, buf) };
 }
 
 [[nodiscard]] inline bool string_to_symbol(uint64_t& result, uint8_t precision, const char*& pos, const char* end,
@@ -383,8 +399,26 @@ inline std::string symbol_code_to_string(uint64_t v) {
    return string_to_symbol(result, pos, end, true);
 }
 
+// The precision, a comma, and the code
+inline constexpr size_t max_symbol_chars = 3 + 1 + max_symbol_code_chars;
+
+// Writes the symbol's characters to dest, which needs room for max_symbol_chars. Returns how many it
+// wrote.
+inline size_t symbol_to_chars(uint64_t v, char* dest) {
+   uint8_t precision = v;
+   size_t  size      = 0;
+   if (precision >= 100)
+      dest[size++] = '0' + precision / 100;
+   if (precision >= 10)
+      dest[size++] = '0' + precision / 10 % 10;
+   dest[size++] = '0' + precision % 10;
+   dest[size++] = ',';
+   return size + symbol_code_to_chars(v >> 8, dest + size);
+}
+
 inline std::string symbol_to_string(uint64_t v) {
-   return std::to_string(v & 0xff) + "," + eosio::symbol_code_to_string(v >> 8);
+   char buf[max_symbol_chars];
+   return { buf, symbol_to_chars(v, buf) };
 }
 
 [[nodiscard]] inline bool string_to_asset(int64_t& amount, uint64_t& symbol, const char*& s, const char* end,
@@ -422,29 +456,39 @@ inline std::string symbol_to_string(uint64_t v) {
    return string_to_asset(amount, symbol, s, end, true);
 }
 
-inline std::string asset_to_string(int64_t amount, uint64_t symbol) {
-   std::string result;
-   uint64_t    uamount;
-   if (amount < 0)
-      uamount = -amount;
-   else
-      uamount = amount;
-   uint8_t precision = symbol;
+// A sign, up to 255 fraction digits, a point, 20 integer digits, a space, and the code
+inline constexpr size_t max_asset_chars = 1 + 255 + 1 + 20 + 1 + max_symbol_code_chars;
+
+// Writes the asset's characters to dest, which needs room for max_asset_chars. Returns how many it
+// wrote.
+inline size_t asset_to_chars(int64_t amount, uint64_t symbol, char* dest) {
+   // Digits come out last first, so they're formed at the end of dest, then moved to the front
+   char*    end       = dest + max_asset_chars;
+   char*    pos       = end;
+   uint64_t uamount   = amount < 0 ? -uint64_t(amount) : uint64_t(amount);
+   uint8_t  precision = symbol;
    if (precision) {
       while (precision--) {
-         result += '0' + uamount % 10;
+         *--pos = '0' + uamount % 10;
          uamount /= 10;
       }
-      result += '.';
+      *--pos = '.';
    }
    do {
-      result += '0' + uamount % 10;
+      *--pos = '0' + uamount % 10;
       uamount /= 10;
    } while (uamount);
    if (amount < 0)
-      result += '-';
-   std::reverse(result.begin(), result.end());
-   return result + ' ' + eosio::symbol_code_to_string(symbol >> 8);
+      *--pos = '-';
+   size_t size = end - pos;
+   memmove(dest, pos, size);
+   dest[size++] = ' ';
+   return size + symbol_code_to_chars(symbol >> 8, dest + size);
+}
+
+inline std::string asset_to_string(int64_t amount, uint64_t symbol) {
+   char buf[max_asset_chars];
+   return { buf, asset_to_chars(amount, symbol, buf) };
 }
 
 } // namespace eosio
@@ -3,6 +3,9 @@
 #include <cstdlib>
 #include "for_each_field.hpp"
 #include "check.hpp"
+#include "hex.hpp"
+#include "json_tokenizer.hpp"
+#include "parse_float.hpp"
 #include <functional>
 #include <optional>
 #include <rapidjson/reader.h>
@@ -11,121 +14,6 @@
 #include <errno.h>
 
 namespace eosio {
-enum class from_json_error {
-   no_error,
-
-   expected_end,
-   expected_null,
-   expected_bool,
-   expected_string,
-   expected_hex_string,
-   hex_string_incorrect_length,
-   invalid_signature,
-   invalid_name,
-   expected_start_object,
-   expected_key,
-   expected_end_object,
-   expected_start_array,
-   expected_end_array,
-   expected_positive_uint,
-   expected_field,
-   expected_variant,
-   expected_public_key,
-   expected_private_key,
-   expected_signature,
-   expected_number,
-   expected_int,
-   expected_time_point,
-   expected_symbol_code,
-   expected_symbol,
-   expected_asset,
-   invalid_type_for_variant,
-   unexpected_field,
-   number_out_of_range,
-   from_json_no_pair,
-
-   // These are from rapidjson:
-   document_empty,
-   document_root_not_singular,
-   value_invalid,
-   object_miss_name,
-   object_miss_colon,
-   object_miss_comma_or_curly_bracket,
-   array_miss_comma_or_square_bracket,
-   string_unicode_escape_invalid_hex,
-   string_unicode_surrogate_invalid,
-   string_escape_invalid,
-   string_miss_quotation_mark,
-   string_invalid_encoding,
-   number_too_big,
-   number_miss_fraction,
-   number_miss_exponent,
-   terminated,
-   unspecific_syntax_error,
-}; // from_json_error
-
-constexpr inline std::string_view convert_json_error(from_json_error e) {
-   switch (e) {
-         // clang-format off
-            case from_json_error::no_error:                            return "No error";
-
-            case from_json_error::expected_end:                        return "Expected end of json";
-            case from_json_error::expected_null:                       return "Expected null";
-            case from_json_error::expected_bool:                       return "Expected true or false";
-            case from_json_error::expected_string:                     return "Expected string";
-            case from_json_error::expected_hex_string:                 return "Expected string containing hex";
-            case from_json_error::hex_string_incorrect_length:         return "Hex string has incorrect length";
-            case from_json_error::invalid_signature:                   return "Invalid signature format";
-            case from_json_error::invalid_name:                        return "Invalid name";
-            case from_json_error::expected_start_object:               return "Expected {";
-            case from_json_error::expected_key:                        return "Expected key";
-            case from_json_error::expected_end_object:                 return "Expected }";
-            case from_json_error::expected_start_array:                return "Expected [";
-            case from_json_error::expected_end_array:                  return "Expected ]";
-            case from_json_error::expected_positive_uint:              return "Expected positive integer";
-            case from_json_error::expected_field:                      return "Expected field";
-            case from_json_error::expected_variant:                    return R"(Expected variant: ["type", value])";
-            case from_json_error::expected_public_key:                 return "Expected public key";
-            case from_json_error::expected_private_key:                return "Expected private key";
-            case from_json_error::expected_signature:                  return "Expected signature";
-            case from_json_error::expected_number:                     return "Expected number or boolean";
-            case from_json_error::expected_int:                        return "Expected integer";
-            case from_json_error::expected_time_point:                 return "Expected time point";
-            case from_json_error::expected_symbol_code:                return "Expected symbol code";
-            case from_json_error::expected_symbol:                     return "Expected symbol";
-            case from_json_error::expected_asset:                      return "Expected asset";
-            case from_json_error::invalid_type_for_variant:            return "Invalid type for variant";
-            case from_json_error::unexpected_field:                    return "Unexpected field";
-            case from_json_error::number_out_of_range:                 return "number is out of range";
-            case from_json_error::from_json_no_pair:                   return "from_json does not support std::pair";
-
-            case from_json_error::document_empty:                      return "The document is empty";
-            case from_json_error::document_root_not_singular:          return "The document root must not follow by other values";
-            case from_json_error::value_invalid:                       return "Invalid value";
-            case from_json_error::object_miss_name:                    return "Missing a name for object member";
-            case from_json_error::object_miss_colon:                   return "Missing a colon after a name of object member";
-            case from_json_error::object_miss_comma_or_curly_bracket:  return "Missing a comma or '}' after an object member";
-            case from_json_error::array_miss_comma_or_square_bracket:  return "Missing a comma or ']' after an array element";
-            case from_json_error::string_unicode_escape_invalid_hex:   return "Incorrect hex digit after \\u escape in string";
-            case from_json_error::string_unicode_surrogate_invalid:    return "The surrogate pair in string is invalid";
-            case from_json_error::string_escape_invalid:               return "Invalid escape character in string";
-            case from_json_error::string_miss_quotation_mark:          return "Missing a closing quotation mark in string";
-            case from_json_error::string_invalid_encoding:             return "Invalid encoding in string";
-            case from_json_error::number_too_big:                      return "Number too big to be stored in double";
-            case from_json_error::number_miss_fraction:                return "Miss fraction part in number";
-            case from_json_error::number_miss_exponent:                return "Miss exponent in number";
-            case from_json_error::terminated:                          return "Parsing was terminated";
-            case from_json_error::unspecific_syntax_error:             return "Unspecific syntax error";
-         // clang-format on
-
-      default: return "unknown";
-   }
-}
-
-constexpr inline std::string_view convert_json_error(int e) {
-   return convert_json_error(static_cast<from_json_error>(e));
-}
-
 inline from_json_error convert_error(rapidjson::ParseErrorCode err) {
    switch (err) {
       // clang-format off
@@ -158,44 +46,91 @@ inline auto convert_error_to_string_view(rapidjson::ParseErrorCode err) {
    return convert_json_error(convert_error(err));
 }
 
-enum class json_token_type {
-   type_unread,
-   type_null,
-   type_bool,
-   type_string,
-   type_start_object,
-   type_key,
-   type_end_object,
-   type_start_array,
-   type_end_array,
-};
-
-struct json_token {
-   json_token_type  type         = {};
-   std::string_view key          = {};
-   bool             value_bool   = {};
-   std::string_view value_string = {};
-};
-
-class json_token_stream : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, json_token_stream> {
+// Reads tokens with rapidjson's iterative parser
+class rapidjson_tokenizer : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, rapidjson_tokenizer> {
  private:
    rapidjson::Reader             reader;
    rapidjson::InsituStringStream ss;
+   json_token*                   token = nullptr;
+
+ public:
+   // This modifies json
+   explicit rapidjson_tokenizer(char* json) : ss{ json } { reader.IterativeParseInit(); }
+
+   bool complete() { return reader.IterativeParseComplete(); }
+
+   void next(json_token& t) {
+      token   = &t;
+      bool ok = reader.IterativeParseNext<rapidjson::kParseInsituFlag | rapidjson::kParseValidateEncodingFlag |
+                                          rapidjson::kParseIterativeFlag | rapidjson::kParseNumbersAsStringsFlag>(ss, *this);
+      // The error code is only meaningful after parsing
+      check( ok, convert_error_to_string_view(reader.GetParseErrorCode()) );
+   }
+
+   // BaseReaderHandler methods
+   bool Null() {
+      token->type = json_token_type::type_null;
+      return true;
+   }
+   bool Bool(bool v) {
+      token->type       = json_token_type::type_bool;
+      token->value_bool = v;
+      return true;
+   }
+   bool RawNumber(const char* v, rapidjson::SizeType length, bool copy) { return String(v, length, copy); }
+   bool Int(int v) { return false; }
+   bool Uint(unsigned v) { return false; }
+   bool Int64(int64_t v) { return false; }
+   bool Uint64(uint64_t v) { return false; }
+   bool Double(double v) { return false; }
+   bool String(const char* v, rapidjson::SizeType length, bool) {
+      token->type         = json_token_type::type_string;
+      token->value_string = { v, length };
+      return true;
+   }
+   bool StartObject() {
+      token->type = json_token_type::type_start_object;
+      return true;
+   }
+   bool Key(const char* v, rapidjson::SizeType length, bool) {
+      token->key  = { v, length };
+      token->type = json_token_type::type_key;
+      return true;
+   }
+   bool EndObject(rapidjson::SizeType) {
+      token->type = json_token_type::type_end_object;
+      return true;
+   }
+   bool StartArray() {
+      token->type = json_token_type::type_start_array;
+      return true;
+   }
+   bool EndArray(rapidjson::SizeType) {
+      token->type = json_token_type::type_end_array;
+      return true;
+   }
+}; // rapidjson_tokenizer
+
+template <typename Tokenizer>
+class basic_json_token_stream {
+ private:
+   Tokenizer tokenizer;
 
  public:
    json_token current_token;
 
    // This modifies json
-   json_token_stream(char* json) : ss{ json } { reader.IterativeParseInit(); }
+   basic_json_token_stream(char* json) : tokenizer{ json } {}
 
-   bool complete() { return reader.IterativeParseComplete(); }
+   // This modifies json, which must have a 0 at json[size]
+   basic_json_token_stream(char* json, size_t size) : tokenizer{ json, size } {}
+
+   bool complete() { return tokenizer.complete(); }
 
    std::reference_wrapper<const json_token> peek_token() {
       if (current_token.type != json_token_type::type_unread)
          return current_token;
-      check( reader.IterativeParseNext<rapidjson::kParseInsituFlag | rapidjson::kParseValidateEncodingFlag |
-                                         rapidjson::kParseIterativeFlag | rapidjson::kParseNumbersAsStringsFlag>(ss, *this),
-            convert_error_to_string_view(reader.GetParseErrorCode()) );
+      tokenizer.next(current_token);
       return current_token;
    }
 
@@ -295,50 +230,10 @@ class json_token_stream : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>,
       check(get_end_array_pred(),
            convert_json_error(from_json_error::expected_end_array));
    }
+}; // basic_json_token_stream
 
-   // BaseReaderHandler methods
-   bool Null() {
-      current_token.type = json_token_type::type_null;
-      return true;
-   }
-   bool Bool(bool v) {
-      current_token.type       = json_token_type::type_bool;
-      current_token.value_bool = v;
-      return true;
-   }
-   bool RawNumber(const char* v, rapidjson::SizeType length, bool copy) { return String(v, length, copy); }
-   bool Int(int v) { return false; }
-   bool Uint(unsigned v) { return false; }
-   bool Int64(int64_t v) { return false; }
-   bool Uint64(uint64_t v) { return false; }
-   bool Double(double v) { return false; }
-   bool String(const char* v, rapidjson::SizeType length, bool) {
-      current_token.type         = json_token_type::type_string;
-      current_token.value_string = { v, length };
-      return true;
-   }
-   bool StartObject() {
-      current_token.type = json_token_type::type_start_object;
-      return true;
-   }
-   bool Key(const char* v, rapidjson::SizeType length, bool) {
-      current_token.key  = { v, length };
-      current_token.type = json_token_type::type_key;
-      return true;
-   }
-   bool EndObject(rapidjson::SizeType) {
-      current_token.type = json_token_type::type_end_object;
-      return true;
-   }
-   bool StartArray() {
-      current_token.type = json_token_type::type_start_array;
-      return true;
-   }
-   bool EndArray(rapidjson::SizeType) {
-      current_token.type = json_token_type::type_end_array;
-      return true;
-   }
-}; // json_token_stream
+using json_token_stream      = basic_json_token_stream<json_tokenizer>;
+using rapidjson_token_stream = basic_json_token_stream<rapidjson_tokenizer>;
 
 template <typename SrcIt, typename DestIt>
 [[nodiscard]] bool unhex(DestIt dest, SrcIt begin, SrcIt end) {
@@ -384,33 +279,35 @@ void from_json(std::string& result, S& stream) {
 /// \exclude
 template <typename T, typename S>
 void from_json_int(T& result, S& stream) {
+   using U = std::make_unsigned_t<T>;
+   // Numbers with fewer digits than T's maximum always fit
+   constexpr int max_digits = std::numeric_limits<T>::digits10 + 1;
    auto r = stream.get_string();
-   auto pos   = r.data();
-   auto end   = pos + r.size();
-   bool found = false;
-   result     = 0;
-   T limit;
-   T sign;
-   if (std::is_signed_v<T> && pos != end && *pos == '-') {
+   auto pos      = r.data();
+   auto end      = pos + r.size();
+   bool negative = std::is_signed_v<T> && pos != end && *pos == '-';
+   if (negative)
       ++pos;
-      sign  = -1;
-      limit = std::numeric_limits<T>::min();
-   } else {
-      sign  = 1;
-      limit = std::numeric_limits<T>::max();
-   }
-   while (pos != end && *pos >= '0' && *pos <= '9') {
-      T digit = (*pos++ - '0');
-      // abs(result) can overflow.  Use -abs(result) instead.
-      // TODO refactor this logic, don't have time now
-      check(!(std::is_signed_v<T> && (-sign * limit + digit) / 10 > -sign * result),
-            convert_json_error(from_json_error::number_out_of_range) );
-      check(!(!std::is_signed_v<T> && (limit - digit) / 10 < result),
+   auto digits = pos;
+   while (pos != end && *pos == '0')
+      ++pos;
+   auto significant = pos;
+   while (pos != end && *pos >= '0' && *pos <= '9')
+      ++pos;
+   check( pos - significant <= max_digits, convert_json_error(from_json_error::number_out_of_range) );
+   U    value = 0;
+   auto last  = pos - significant == max_digits ? pos - 1 : pos;
+   for (auto p = significant; p != last; ++p)
+      value = value * 10 + U(*p - '0');
+   if (last != pos) {
+      U limit = U(std::numeric_limits<T>::max()) + negative;
+      U digit = *last - '0';
+      check( value < limit / 10 || (value == limit / 10 && digit <= limit % 10),
             convert_json_error(from_json_error::number_out_of_range) );
-      result = result * 10 + sign * digit;
-      found  = true;
+      value = value * 10 + digit;
    }
-   check( pos == end && found, convert_json_error(from_json_error::expected_int) );
+   check( pos == end && pos != digits, convert_json_error(from_json_error::expected_int) );
+   result = negative ? T(U(0) - value) : T(value);
 }
 
 /// \group from_json_explicit
@@ -481,6 +378,8 @@ template <typename S>
 void from_json(float& result, S& stream) {
    auto sv = stream.get_string();
    check( !sv.empty(), convert_json_error(from_json_error::expected_number) );
+   if (parse_float(result, sv))
+      return;
    std::string s(sv); // strtof expects a null-terminated string
    errno = 0;
    char* end;
@@ -493,6 +392,8 @@ template <typename S>
 void from_json(double& result, S& stream) {
    auto sv = stream.get_string();
    check( !sv.empty(), convert_json_error(from_json_error::expected_number) );
+   if (parse_float(result, sv))
+      return;
    std::string s(sv);
    errno = 0;
    char* end;
@@ -589,9 +490,8 @@ template <typename S>
 void from_json_hex(std::vector<char>& result, S& stream) {
    auto s = stream.get_string();
    check( !(s.size() & 1), convert_json_error(from_json_error::expected_hex_string) );
-   result.clear();
-   result.reserve(s.size() / 2);
-   check( unhex(std::back_inserter(result), s.begin(), s.end()),
+   result.resize(s.size() / 2);
+   check( hex_decode(result.data(), s.data(), s.size()),
          convert_json_error(from_json_error::expected_hex_string) );
 }
 
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+namespace eosio {
+
+inline constexpr char hex_digits[] = "0123456789ABCDEF";
+
+// Writes 2 * size uppercase hex digits of data to dest
+inline void hex_encode(char* dest, const char* data, size_t size) {
+   size_t i = 0;
+#if defined(__SSE2__)
+   // 16 bytes become 32 digits: split each byte into nibbles, interleave them high first, then
+   // map 0-9 to '0'-'9' and 10-15 to 'A'-'F'
+   const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+   auto          digits      = [](__m128i n) {
+      __m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+      return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), _mm_and_si128(letter, _mm_set1_epi8('A' - '0' - 10)));
+   };
+   for (; size - i >= 16; i += 16) {
+      __m128i x  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), nibble_mask);
+      __m128i lo = _mm_and_si128(x, nibble_mask);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 2 * i), digits(_mm_unpacklo_epi8(hi, lo)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 2 * i + 16), digits(_mm_unpackhi_epi8(hi, lo)));
+   }
+#endif
+   for (; i < size; ++i) {
+      unsigned char byte = data[i];
+      dest[2 * i]        = hex_digits[byte >> 4];
+      dest[2 * i + 1]    = hex_digits[byte & 15];
+   }
+}
+
+// Converts size hex digits (either case) to size / 2 bytes at dest. Returns false if size is odd or
+// a character isn't a hex digit; dest may be partly written by then.
+inline bool hex_decode(char* dest, const char* hex, size_t size) {
+   if (size & 1)
+      return false;
+   size_t i = 0;
+#if defined(__SSE2__)
+   // Each lane is a digit if c - '0' < 10, or a letter if (c | 0x20) - 'a' < 6, compared unsigned.
+   // Pairs of nibbles become bytes in 16-bit lanes, which packus narrows.
+   auto nibbles = [](__m128i c, __m128i& valid) {
+      const __m128i bias      = _mm_set1_epi8(-128);
+      __m128i       digit     = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+      __m128i       letter    = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+      __m128i       is_digit  = _mm_cmplt_epi8(_mm_xor_si128(digit, bias), _mm_set1_epi8(-128 + 10));
+      __m128i       is_letter = _mm_cmplt_epi8(_mm_xor_si128(letter, bias), _mm_set1_epi8(-128 + 6));
+      valid                   = _mm_and_si128(valid, _mm_or_si128(is_digit, is_letter));
+      return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                          _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+   };
+   auto bytes = [](__m128i n) {
+      return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0xff)), 4), _mm_srli_epi16(n, 8));
+   };
+   for (; size - i >= 32; i += 32) {
+      __m128i valid = _mm_set1_epi8(-1);
+      __m128i a     = nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i)), valid);
+      __m128i b     = nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i + 16)), valid);
+      if (_mm_movemask_epi8(valid) != 0xffff)
+         return false;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i / 2), _mm_packus_epi16(bytes(a), bytes(b)));
+   }
+#endif
+   auto nibble = [](char c, uint8_t& result) {
+      if (c >= '0' && c <= '9')
+         result = c - '0';
+      else if (c >= 'a' && c <= 'f')
+         result = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+         result = c - 'A' + 10;
+      else
+         return false;
+      return true;
+   };
+   for (; i < size; i += 2) {
+      uint8_t h, l;
+      if (!nibble(hex[i], h) || !nibble(hex[i + 1], l))
+         return false;
+      dest[i / 2] = (h << 4) | l;
+   }
+   return true;
+}
+
+} // namespace eosio
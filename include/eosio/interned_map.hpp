@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "murmur.hpp"
+
+namespace eosio {
+
+// Open-addressed index of entries which live elsewhere. Slots hold each entry's hash and its
+// position; callers compare keys.
+class flat_string_index {
+ public:
+   static uint32_t hash(std::string_view s) { return murmur64(s.data(), s.size()); }
+
+   // Returns the position of the entry whose key equals s, or npos
+   template <typename KeyAt>
+   uint32_t find(std::string_view s, uint32_t h, const KeyAt& key_at) const {
+      if (slots.empty())
+         return npos;
+      for (size_t i = h & mask();; i = (i + 1) & mask()) {
+         auto& slot = slots[i];
+         if (!slot.position)
+            return npos;
+         if (slot.hash == h && key_at(slot.position - 1) == s)
+            return slot.position - 1;
+      }
+   }
+
+   // position must not be in the index yet
+   void insert(uint32_t h, uint32_t position) {
+      if ((count + 1) * 2 > slots.size())
+         grow();
+      place({h, position + 1});
+      ++count;
+   }
+
+   static constexpr uint32_t npos = 0xffff'ffff;
+
+ private:
+   struct slot {
+      uint32_t hash     = 0;
+      uint32_t position = 0; // 1-based; 0 marks an empty slot
+   };
+
+   size_t mask() const { return slots.size() - 1; }
+
+   void place(slot s) {
+      size_t i = s.hash & mask();
+      while (slots[i].position)
+         i = (i + 1) & mask();
+      slots[i] = s;
+   }
+
+   void grow() {
+      auto old = std::move(slots);
+      slots.assign(old.empty() ? 16 : old.size() * 2, slot{});
+      for (auto& s : old)
+         if (s.position)
+            place(s);
+   }
+
+   std::vector<slot> slots;
+   size_t            count = 0;
+};
+
+// Holds strings for as long as the pool lives. Each distinct string is stored once.
+class string_pool {
+ public:
+   string_pool() = default;
+   string_pool(string_pool&&) = default;
+   string_pool& operator=(string_pool&&) = default;
+
+   std::string_view intern(std::string_view s) {
+      auto h = flat_string_index::hash(s);
+      auto pos = index.find(s, h, [&](uint32_t i) { return strings[i]; });
+      if (pos != flat_string_index::npos)
+         return strings[pos];
+      auto result = store(s);
+      index.insert(h, strings.size());
+      strings.push_back(result);
+      return result;
+   }
+
+ private:
+   static constexpr size_t block_size = 4096;
+
+   std::string_view store(std::string_view s) {
+      if (s.size() > block_size / 4) {
+         large.push_back(std::make_unique<char[]>(s.size()));
+         memcpy(large.back().get(), s.data(), s.size());
+         return { large.back().get(), s.size() };
+      }
+      if (blocks.empty() || block_size - used < s.size()) {
+         blocks.push_back(std::make_unique<char[]>(block_size));
+         used = 0;
+      }
+      char* p = blocks.back().get() + used;
+      memcpy(p, s.data(), s.size());
+      used += s.size();
+      return { p, s.size() };
+   }
+
+   std::vector<std::unique_ptr<char[]>> blocks;
+   std::vector<std::unique_ptr<char[]>> large;
+   size_t                               used = 0;
+   std::vector<std::string_view>        strings;
+   flat_string_index                    index;
+};
+
+// Map from names to values which never move. Names are interned in the map's string_pool,
+// and each value is constructed with its interned name as its first argument. Iterates in
+// insertion order. Adding an entry invalidates iterators, but not references.
+template <typename T>
+class interned_map {
+ public:
+   using value_type = std::pair<const std::string_view, T>;
+   using iterator = typename std::deque<value_type>::iterator;
+   using const_iterator = typename std::deque<value_type>::const_iterator;
+
+   interned_map() = default;
+   interned_map(interned_map&&) = default;
+   interned_map& operator=(interned_map&&) = default;
+
+   iterator       begin() { return nodes.begin(); }
+   iterator       end() { return nodes.end(); }
+   const_iterator begin() const { return nodes.begin(); }
+   const_iterator end() const { return nodes.end(); }
+   size_t         size() const { return nodes.size(); }
+   size_t         count(std::string_view name) const { return find(name) != end(); }
+
+   iterator find(std::string_view name) {
+      auto pos = index.find(name, flat_string_index::hash(name), key_at());
+      return pos == flat_string_index::npos ? end() : begin() + pos;
+   }
+
+   const_iterator find(std::string_view name) const {
+      auto pos = index.find(name, flat_string_index::hash(name), key_at());
+      return pos == flat_string_index::npos ? end() : begin() + pos;
+   }
+
+   template <typename... Args>
+   std::pair<iterator, bool> try_emplace(std::string_view name, Args&&... args) {
+      auto h = flat_string_index::hash(name);
+      auto pos = index.find(name, h, key_at());
+      if (pos != flat_string_index::npos)
+         return { begin() + pos, false };
+      auto key = names.intern(name);
+      nodes.emplace_back(std::piecewise_construct, std::forward_as_tuple(key),
+                         std::forward_as_tuple(key, std::forward<Args>(args)...));
+      index.insert(h, nodes.size() - 1);
+      return { end() - 1, true };
+   }
+
+   // Strings which live as long as the map
+   std::string_view intern(std::string_view s) { return names.intern(s); }
+
+ private:
+   auto key_at() const {
+      return [this](uint32_t i) { return nodes[i].first; };
+   }
+
+   string_pool             names;
+   std::deque<value_type>  nodes;
+   flat_string_index       index;
+};
+
+} // namespace eosio
@@ -0,0 +1,535 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "check.hpp"
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+namespace eosio {
+
+enum class from_json_error {
+   no_error,
+
+   expected_end,
+   expected_null,
+   expected_bool,
+   expected_string,
+   expected_hex_string,
+   hex_string_incorrect_length,
+   invalid_signature,
+   invalid_name,
+   expected_start_object,
+   expected_key,
+   expected_end_object,
+   expected_start_array,
+   expected_end_array,
+   expected_positive_uint,
+   expected_field,
+   expected_variant,
+   expected_public_key,
+   expected_private_key,
+   expected_signature,
+   expected_number,
+   expected_int,
+   expected_time_point,
+   expected_symbol_code,
+   expected_symbol,
+   expected_asset,
+   invalid_type_for_variant,
+   unexpected_field,
+   number_out_of_range,
+   from_json_no_pair,
+
+   // These are from rapidjson:
+   document_empty,
+   document_root_not_singular,
+   value_invalid,
+   object_miss_name,
+   object_miss_colon,
+   object_miss_comma_or_curly_bracket,
+   array_miss_comma_or_square_bracket,
+   string_unicode_escape_invalid_hex,
+   string_unicode_surrogate_invalid,
+   string_escape_invalid,
+   string_miss_quotation_mark,
+   string_invalid_encoding,
+   number_too_big,
+   number_miss_fraction,
+   number_miss_exponent,
+   terminated,
+   unspecific_syntax_error,
+}; // from_json_error
+
+constexpr inline std::string_view convert_json_error(from_json_error e) {
+   switch (e) {
+         // clang-format off
+            case from_json_error::no_error:                            return "No error";
+
+            case from_json_error::expected_end:                        return "Expected end of json";
+            case from_json_error::expected_null:                       return "Expected null";
+            case from_json_error::expected_bool:                       return "Expected true or false";
+            case from_json_error::expected_string:                     return "Expected string";
+            case from_json_error::expected_hex_string:                 return "Expected string containing hex";
+            case from_json_error::hex_string_incorrect_length:         return "Hex string has incorrect length";
+            case from_json_error::invalid_signature:                   return "Invalid signature format";
+            case from_json_error::invalid_name:                        return "Invalid name";
+            case from_json_error::expected_start_object:               return "Expected {";
+            case from_json_error::expected_key:                        return "Expected key";
+            case from_json_error::expected_end_object:                 return "Expected }";
+            case from_json_error::expected_start_array:                return "Expected [";
+            case from_json_error::expected_end_array:                  return "Expected ]";
+            case from_json_error::expected_positive_uint:              return "Expected positive integer";
+            case from_json_error::expected_field:                      return "Expected field";
+            case from_json_error::expected_variant:                    return R"(Expected variant: ["type", value])";
+            case from_json_error::expected_public_key:                 return "Expected public key";
+            case from_json_error::expected_private_key:                return "Expected private key";
+            case from_json_error::expected_signature:                  return "Expected signature";
+            case from_json_error::expected_number:                     return "Expected number or boolean";
+            case from_json_error::expected_int:                        return "Expected integer";
+            case from_json_error::expected_time_point:                 return "Expected time point";
+            case from_json_error::expected_symbol_code:                return "Expected symbol code";
+            case from_json_error::expected_symbol:                     return "Expected symbol";
+            case from_json_error::expected_asset:                      return "Expected asset";
+            case from_json_error::invalid_type_for_variant:            return "Invalid type for variant";
+            case from_json_error::unexpected_field:                    return "Unexpected field";
+            case from_json_error::number_out_of_range:                 return "number is out of range";
+            case from_json_error::from_json_no_pair:                   return "from_json does not support std::pair";
+
+            case from_json_error::document_empty:                      return "The document is empty";
+            case from_json_error::document_root_not_singular:          return "The document root must not follow by other values";
+            case from_json_error::value_invalid:                       return "Invalid value";
+            case from_json_error::object_miss_name:                    return "Missing a name for object member";
+            case from_json_error::object_miss_colon:                   return "Missing a colon after a name of object member";
+            case from_json_error::object_miss_comma_or_curly_bracket:  return "Missing a comma or '}' after an object member";
+            case from_json_error::array_miss_comma_or_square_bracket:  return "Missing a comma or ']' after an array element";
+            case from_json_error::string_unicode_escape_invalid_hex:   return "Incorrect hex digit after \\u escape in string";
+            case from_json_error::string_unicode_surrogate_invalid:    return "The surrogate pair in string is invalid";
+            case from_json_error::string_escape_invalid:               return "Invalid escape character in string";
+            case from_json_error::string_miss_quotation_mark:          return "Missing a closing quotation mark in string";
+            case from_json_error::string_invalid_encoding:             return "Invalid encoding in string";
+            case from_json_error::number_too_big:                      return "Number too big to be stored in double";
+            case from_json_error::number_miss_fraction:                return "Miss fraction part in number";
+            case from_json_error::number_miss_exponent:                return "Miss exponent in number";
+            case from_json_error::terminated:                          return "Parsing was terminated";
+            case from_json_error::unspecific_syntax_error:             return "Unspecific syntax error";
+         // clang-format on
+
+      default: return "unknown";
+   }
+}
+
+constexpr inline std::string_view convert_json_error(int e) {
+   return convert_json_error(static_cast<from_json_error>(e));
+}
+
+enum class json_token_type {
+   type_unread,
+   type_null,
+   type_bool,
+   type_string,
+   type_start_object,
+   type_key,
+   type_end_object,
+   type_start_array,
+   type_end_array,
+};
+
+struct json_token {
+   json_token_type  type         = {};
+   std::string_view key          = {};
+   bool             value_bool   = {};
+   std::string_view value_string = {};
+};
+
+// Splits json into json_tokens in place: strings are unescaped over the json they came from.
+// Accepts the same documents as rapidjson's iterative parser with kParseInsituFlag,
+// kParseValidateEncodingFlag and kParseNumbersAsStringsFlag, and reports the same errors.
+//
+// Strings and whitespace make up most of a typical action's json. Where SSE2 is available,
+// they are scanned 16 bytes at a time; otherwise one byte at a time.
+class json_tokenizer {
+ public:
+   // json must be null-terminated
+   explicit json_tokenizer(char* json) : pos{ json }, end{ json + strlen(json) } {}
+
+   // json[size] must be 0
+   json_tokenizer(char* json, size_t size) : pos{ json }, end{ json + size } {}
+
+   bool complete() const { return state == expect::done; }
+
+   // Reads the next token into token. Throws on a syntax error.
+   void next(json_token& token) {
+      skip_whitespace();
+      switch (state) {
+         case expect::root:
+            if (!*pos)
+               fail(from_json_error::document_empty);
+            return value(token);
+         case expect::first_key:
+            if (*pos == '}')
+               return end_container(token);
+            if (*pos != '"')
+               fail(from_json_error::object_miss_name);
+            return key(token);
+         case expect::colon:
+            if (*pos != ':')
+               fail(from_json_error::object_miss_colon);
+            ++pos;
+            skip_whitespace();
+            return value(token);
+         case expect::first_value:
+            if (*pos == ']')
+               return end_container(token);
+            return value(token);
+         case expect::comma:
+            if (containers.back() == '{') {
+               if (*pos == '}')
+                  return end_container(token);
+               if (*pos != ',')
+                  fail(from_json_error::object_miss_comma_or_curly_bracket);
+               ++pos;
+               skip_whitespace();
+               if (*pos != '"')
+                  fail(from_json_error::object_miss_name);
+               return key(token);
+            } else {
+               if (*pos == ']')
+                  return end_container(token);
+               if (*pos != ',')
+                  fail(from_json_error::array_miss_comma_or_square_bracket);
+               ++pos;
+               skip_whitespace();
+               return value(token);
+            }
+         case expect::done: fail(from_json_error::terminated);
+      }
+   }
+
+ private:
+   enum class expect : uint8_t { root, first_key, colon, first_value, comma, done };
+
+   [[noreturn]] static void fail(from_json_error e) { check(false, convert_json_error(e)); __builtin_unreachable(); }
+
+   static bool is_whitespace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+   void skip_whitespace() {
+      if (!is_whitespace(*pos))
+         return;
+      ++pos;
+#if defined(__SSE2__)
+      // Indentation comes in runs
+      while (end - pos >= 16) {
+         __m128i  x    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+         __m128i  ws   = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'))),
+                                      _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'))));
+         unsigned mask = ~unsigned(_mm_movemask_epi8(ws)) & 0xffff;
+         if (mask) {
+            pos += __builtin_ctz(mask);
+            return;
+         }
+         pos += 16;
+      }
+#endif
+      while (is_whitespace(*pos))
+         ++pos;
+   }
+
+   void value(json_token& token) {
+      switch (*pos) {
+         case '{':
+            ++pos;
+            containers.push_back('{');
+            token.type = json_token_type::type_start_object;
+            state      = expect::first_key;
+            return;
+         case '[':
+            ++pos;
+            containers.push_back('[');
+            token.type = json_token_type::type_start_array;
+            state      = expect::first_value;
+            return;
+         case '"':
+            token.value_string = string();
+            token.type         = json_token_type::type_string;
+            return value_done();
+         case 'n':
+            literal("null");
+            token.type = json_token_type::type_null;
+            return value_done();
+         case 't':
+            literal("true");
+            token.type       = json_token_type::type_bool;
+            token.value_bool = true;
+            return value_done();
+         case 'f':
+            literal("false");
+            token.type       = json_token_type::type_bool;
+            token.value_bool = false;
+            return value_done();
+         default:
+            token.value_string = number();
+            token.type         = json_token_type::type_string;
+            return value_done();
+      }
+   }
+
+   void key(json_token& token) {
+      token.key  = string();
+      token.type = json_token_type::type_key;
+      state      = expect::colon;
+   }
+
+   void end_container(json_token& token) {
+      ++pos;
+      token.type = containers.back() == '{' ? json_token_type::type_end_object : json_token_type::type_end_array;
+      containers.pop_back();
+      value_done();
+   }
+
+   void value_done() {
+      if (!containers.empty()) {
+         state = expect::comma;
+         return;
+      }
+      skip_whitespace();
+      if (*pos)
+         fail(from_json_error::document_root_not_singular);
+      state = expect::done;
+   }
+
+   void literal(std::string_view s) {
+      if (size_t(end - pos) < s.size() || memcmp(pos, s.data(), s.size()))
+         fail(from_json_error::value_invalid);
+      pos += s.size();
+   }
+
+   static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+   // Numbers stay strings, but rapidjson still rejects some as too big for a double while scanning
+   // them: an integer part which reaches DBL_MAX / 10 after it no longer fits in 64 bits, or a
+   // positive exponent above 308 plus the count of fraction digits it kept in its significand.
+   // This mirrors those rules, including which fraction digits count.
+   std::string_view number() {
+      char* begin = pos;
+      bool  minus = *pos == '-';
+      if (minus)
+         ++pos;
+      uint64_t i64                = 0;
+      double   d                  = 0;
+      bool     use_double         = false;
+      int      significand_digits = 0;
+      if (*pos == '0') {
+         ++pos;
+      } else if (*pos >= '1' && *pos <= '9') {
+         i64 = *pos++ - '0';
+         // Past these, the magnitude no longer fits in int64_t or uint64_t
+         const uint64_t limit = minus ? 0x0CCCCCCCCCCCCCCC : 0x1999999999999999;
+         const char     last  = minus ? '8' : '5';
+         for (; is_digit(*pos); ++pos, ++significand_digits) {
+            if (i64 >= limit && (i64 != limit || *pos > last)) {
+               d          = double(i64);
+               use_double = true;
+               break;
+            }
+            i64 = i64 * 10 + (*pos - '0');
+         }
+         for (; use_double && is_digit(*pos); ++pos) {
+            if (d >= 1.7976931348623157e307)
+               fail(from_json_error::number_too_big);
+            d = d * 10 + (*pos - '0');
+         }
+      } else {
+         fail(from_json_error::value_invalid);
+      }
+      int exp_frac = 0;
+      if (*pos == '.') {
+         ++pos;
+         if (!is_digit(*pos))
+            fail(from_json_error::number_miss_fraction);
+         if (!use_double) {
+            for (; is_digit(*pos) && i64 <= 0x1FFFFFFFFFFFFF; ++pos) {
+               i64 = i64 * 10 + (*pos - '0');
+               --exp_frac;
+               if (i64)
+                  ++significand_digits;
+            }
+            d = double(i64);
+         }
+         for (; is_digit(*pos); ++pos) {
+            if (significand_digits < 17) {
+               d = d * 10 + (*pos - '0');
+               --exp_frac;
+               if (d > 0)
+                  ++significand_digits;
+            }
+         }
+      }
+      if (*pos == 'e' || *pos == 'E') {
+         ++pos;
+         bool negative = *pos == '-';
+         if (*pos == '+' || *pos == '-')
+            ++pos;
+         if (!is_digit(*pos))
+            fail(from_json_error::number_miss_exponent);
+         int max_exp = 308 - exp_frac;
+         int exp     = *pos++ - '0';
+         for (; is_digit(*pos); ++pos) {
+            if (!negative && (exp = exp * 10 + (*pos - '0')) > max_exp)
+               fail(from_json_error::number_too_big);
+         }
+      }
+      return { begin, size_t(pos - begin) };
+   }
+
+   static int hex_digit(char c) {
+      if (c >= '0' && c <= '9')
+         return c - '0';
+      if (c >= 'a' && c <= 'f')
+         return c - 'a' + 10;
+      if (c >= 'A' && c <= 'F')
+         return c - 'A' + 10;
+      return -1;
+   }
+
+   unsigned unicode_escape(const char*& src) {
+      unsigned result = 0;
+      for (int i = 0; i < 4; ++i) {
+         int d = hex_digit(*src);
+         if (d < 0)
+            fail(from_json_error::string_unicode_escape_invalid_hex);
+         result = result * 16 + d;
+         ++src;
+      }
+      return result;
+   }
+
+   static char* put_utf8(char* dst, unsigned cp) {
+      if (cp < 0x80) {
+         *dst++ = cp;
+      } else if (cp < 0x800) {
+         *dst++ = 0xc0 | (cp >> 6);
+         *dst++ = 0x80 | (cp & 0x3f);
+      } else if (cp < 0x10000) {
+         *dst++ = 0xe0 | (cp >> 12);
+         *dst++ = 0x80 | ((cp >> 6) & 0x3f);
+         *dst++ = 0x80 | (cp & 0x3f);
+      } else {
+         *dst++ = 0xf0 | (cp >> 18);
+         *dst++ = 0x80 | ((cp >> 12) & 0x3f);
+         *dst++ = 0x80 | ((cp >> 6) & 0x3f);
+         *dst++ = 0x80 | (cp & 0x3f);
+      }
+      return dst;
+   }
+
+   // Returns the length of the valid UTF-8 sequence at src, which starts with a byte >= 0x80
+   static int utf8_sequence(const unsigned char* src) {
+      auto in = [](unsigned char c, unsigned char lo, unsigned char hi) { return c >= lo && c <= hi; };
+      unsigned char c = src[0];
+      if (in(c, 0xc2, 0xdf))
+         return in(src[1], 0x80, 0xbf) ? 2 : 0;
+      unsigned char lo = 0x80, hi = 0xbf;
+      if (c == 0xe0)
+         lo = 0xa0;
+      else if (c == 0xed)
+         hi = 0x9f;
+      else if (c == 0xf0)
+         lo = 0x90;
+      else if (c == 0xf4)
+         hi = 0x8f;
+      if (in(c, 0xe0, 0xef))
+         return in(src[1], lo, hi) && in(src[2], 0x80, 0xbf) ? 3 : 0;
+      if (in(c, 0xf0, 0xf4))
+         return in(src[1], lo, hi) && in(src[2], 0x80, 0xbf) && in(src[3], 0x80, 0xbf) ? 4 : 0;
+      return 0;
+   }
+
+   // Unescapes the string at pos over itself
+   std::string_view string() {
+      char*       begin = ++pos;
+      char*       dst   = begin;
+      const char* src   = begin;
+      while (true) {
+#if defined(__SSE2__)
+         // Find the next byte which isn't plain ASCII: '"', '\\', a control character, or >= 0x80
+         while (end - src >= 16) {
+            __m128i  x       = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i  special = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+            // Signed compare: bytes >= 0x80 are negative, so they're also less than 0x20
+            special       = _mm_or_si128(special, _mm_cmplt_epi8(x, _mm_set1_epi8(0x20)));
+            unsigned mask = _mm_movemask_epi8(special);
+            if (!mask) {
+               if (dst != src)
+                  _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), x);
+               src += 16;
+               dst += 16;
+               continue;
+            }
+            auto n = __builtin_ctz(mask);
+            if (dst != src)
+               memmove(dst, src, n);
+            src += n;
+            dst += n;
+            break;
+         }
+#endif
+         unsigned char c = *src;
+         if (c == '"') {
+            *dst = 0;
+            pos  = const_cast<char*>(src) + 1;
+            return { begin, size_t(dst - begin) };
+         } else if (c == '\\') {
+            ++src;
+            switch (*src++) {
+               case '"': *dst++ = '"'; break;
+               case '\\': *dst++ = '\\'; break;
+               case '/': *dst++ = '/'; break;
+               case 'b': *dst++ = '\b'; break;
+               case 'f': *dst++ = '\f'; break;
+               case 'n': *dst++ = '\n'; break;
+               case 'r': *dst++ = '\r'; break;
+               case 't': *dst++ = '\t'; break;
+               case 'u': {
+                  unsigned cp = unicode_escape(src);
+                  if (cp >= 0xd800 && cp <= 0xdbff) {
+                     if (src[0] != '\\' || src[1] != 'u')
+                        fail(from_json_error::string_unicode_surrogate_invalid);
+                     src += 2;
+                     unsigned low = unicode_escape(src);
+                     if (low < 0xdc00 || low > 0xdfff)
+                        fail(from_json_error::string_unicode_surrogate_invalid);
+                     cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                  } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+                     fail(from_json_error::string_unicode_surrogate_invalid);
+                  }
+                  dst = put_utf8(dst, cp);
+                  break;
+               }
+               default: fail(from_json_error::string_escape_invalid);
+            }
+         } else if (c < 0x20) {
+            fail(c ? from_json_error::string_invalid_encoding : from_json_error::string_miss_quotation_mark);
+         } else if (c >= 0x80) {
+            int n = utf8_sequence(reinterpret_cast<const unsigned char*>(src));
+            if (!n)
+               fail(from_json_error::string_invalid_encoding);
+            for (int i = 0; i < n; ++i)
+               *dst++ = *src++;
+         } else {
+            *dst++ = *src++;
+         }
+      }
+   }
+
+   char*             pos;
+   char*             end;
+   expect            state = expect::root;
+   std::vector<char> containers;
+};
+
+} // namespace eosio
@@ -1,3 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
   
 namespace eosio {
 namespace {
@@ -158,7 +158,11 @@ void from_json(name& obj, S& stream) {
 
 template <typename S>
 void to_json(const name& obj, S& stream) {
-   to_json(eosio::name_to_string(obj.value), stream);
+   char buf[max_name_chars + 2];
+   auto size     = name_to_chars(obj.value, buf + 1);
+   buf[0]        = '"';
+   buf[size + 1] = '"';
+   stream.write(buf, size + 2);
 }
 
 inline namespace literals {
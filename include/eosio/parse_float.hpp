@@ -0,0 +1,182 @@
+#pragma once
+
+#include "powers_of_five.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace eosio {
+
+template <typename T>
+struct float_format;
+
+template <>
+struct float_format<double> {
+   using bits                                    = uint64_t;
+   static constexpr int      mantissa_bits         = 52;
+   static constexpr int      minimum_exponent      = -1023;
+   static constexpr int      infinite_power        = 0x7ff;
+   static constexpr int      smallest_power_of_ten = -342;
+   static constexpr int      largest_power_of_ten  = 308;
+   static constexpr int      min_round_to_even     = -4;
+   static constexpr int      max_round_to_even     = 23;
+   static constexpr int      max_exact_power       = 22;
+   static constexpr uint64_t max_exact_mantissa    = uint64_t(1) << 53;
+   static constexpr double   exact_powers[]        = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                             1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                             1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+};
+
+template <>
+struct float_format<float> {
+   using bits                                    = uint32_t;
+   static constexpr int      mantissa_bits         = 23;
+   static constexpr int      minimum_exponent      = -127;
+   static constexpr int      infinite_power        = 0xff;
+   static constexpr int      smallest_power_of_ten = -65;
+   static constexpr int      largest_power_of_ten  = 38;
+   static constexpr int      min_round_to_even     = -17;
+   static constexpr int      max_round_to_even     = 10;
+   static constexpr int      max_exact_power       = 10;
+   static constexpr uint64_t max_exact_mantissa    = uint64_t(1) << 24;
+   static constexpr float    exact_powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+};
+
+struct uint128_parts {
+   uint64_t high;
+   uint64_t low;
+};
+
+inline uint128_parts full_multiplication(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+   auto r = (unsigned __int128)a * b;
+   return { uint64_t(r >> 64), uint64_t(r) };
+#else
+   uint64_t a_lo = uint32_t(a), a_hi = a >> 32, b_lo = uint32_t(b), b_hi = b >> 32;
+   uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+   uint64_t cross = (lo_lo >> 32) + uint32_t(hi_lo) + lo_hi;
+   return { hi_hi + (hi_lo >> 32) + (cross >> 32), (cross << 32) | uint32_t(lo_lo) };
+#endif
+}
+
+// Converts w * 10^q to T's bits with the Eisel-Lemire algorithm. w must be nonzero. Returns false if
+// the result is subnormal, zero, or infinite, or the product isn't precise enough to round correctly.
+template <typename T>
+bool eisel_lemire(typename float_format<T>::bits& result, uint64_t w, int64_t q) {
+   using format = float_format<T>;
+   if (q < format::smallest_power_of_ten || q > format::largest_power_of_ten)
+      return false;
+   int lz = __builtin_clzll(w);
+   w <<= lz;
+
+   // Enough bits of w * 5^q to find the mantissa and its rounding bit
+   int  index   = 2 * int(q - smallest_power_of_five);
+   auto product = full_multiplication(w, power_of_five_128[index]);
+   constexpr uint64_t precision_mask = ~uint64_t(0) >> (format::mantissa_bits + 3);
+   if ((product.high & precision_mask) == precision_mask) {
+      auto low = full_multiplication(w, power_of_five_128[index + 1]);
+      product.low += low.high;
+      if (low.high > product.low)
+         ++product.high;
+   }
+   if (product.low == ~uint64_t(0) && (q < -27 || q > 55))
+      return false;
+
+   int      upper_bit = int(product.high >> 63);
+   int      shift     = upper_bit + 64 - format::mantissa_bits - 3;
+   uint64_t mantissa  = product.high >> shift;
+   int32_t  power2    = int32_t(((152170 + 65536) * int32_t(q)) >> 16) + 63 + upper_bit - lz - format::minimum_exponent;
+   if (power2 <= 0)
+      return false;
+
+   // Ties round to even
+   if (product.low <= 1 && q >= format::min_round_to_even && q <= format::max_round_to_even && (mantissa & 3) == 1 &&
+       (mantissa << shift) == product.high)
+      mantissa &= ~uint64_t(1);
+   mantissa += mantissa & 1;
+   mantissa >>= 1;
+   if (mantissa >= (uint64_t(2) << format::mantissa_bits)) {
+      mantissa = uint64_t(1) << format::mantissa_bits;
+      ++power2;
+   }
+   mantissa &= ~(uint64_t(1) << format::mantissa_bits);
+   if (power2 >= format::infinite_power)
+      return false;
+   result = typename format::bits(mantissa | (uint64_t(power2) << format::mantissa_bits));
+   return true;
+}
+
+// Parses a json number (-?digits(.digits)?([eE][+-]?digits)?) into result, correctly rounded, without
+// copying it or touching errno. Returns false if s has another form or needs more care than this gives:
+// over 19 significant digits, or a result which underflows, is subnormal, or overflows. Callers use strtod
+// for those, so the results and errors match strtod's.
+template <typename T>
+bool parse_float(T& result, std::string_view s) {
+   using format    = float_format<T>;
+   auto is_digit   = [](char c) { return c >= '0' && c <= '9'; };
+   const char* pos = s.data();
+   const char* end = pos + s.size();
+   bool        negative = pos != end && *pos == '-';
+   if (negative)
+      ++pos;
+   if (pos == end || !is_digit(*pos))
+      return false;
+
+   uint64_t w           = 0;
+   int      digits      = 0;
+   int64_t  exp         = 0;
+   auto     add_digit   = [&](char c) {
+      if (w || c != '0')
+         ++digits;
+      w = w * 10 + (c - '0');
+   };
+   for (; pos != end && is_digit(*pos); ++pos)
+      add_digit(*pos);
+   if (pos != end && *pos == '.') {
+      auto frac = ++pos;
+      for (; pos != end && is_digit(*pos); ++pos)
+         add_digit(*pos);
+      if (pos == frac)
+         return false;
+      exp -= pos - frac;
+   }
+   if (pos != end && (*pos == 'e' || *pos == 'E')) {
+      ++pos;
+      bool exp_negative = pos != end && *pos == '-';
+      if (pos != end && (*pos == '-' || *pos == '+'))
+         ++pos;
+      if (pos == end || !is_digit(*pos))
+         return false;
+      int64_t e = 0;
+      for (; pos != end && is_digit(*pos); ++pos)
+         if (e < 100000)
+            e = e * 10 + (*pos - '0');
+      exp += exp_negative ? -e : e;
+   }
+   if (pos != end || digits > 19)
+      return false;
+
+   if (!w) {
+      result = negative ? -T(0) : T(0);
+      return true;
+   }
+   if (w <= format::max_exact_mantissa && exp >= -format::max_exact_power && exp <= format::max_exact_power) {
+      // w and 10^|exp| are exact, so one rounding gives the correctly rounded result
+      T value = T(w);
+      if (exp < 0)
+         value /= format::exact_powers[-exp];
+      else
+         value *= format::exact_powers[exp];
+      result = negative ? -value : value;
+      return true;
+   }
+   typename format::bits bits;
+   if (!eisel_lemire<T>(bits, w, exp))
+      return false;
+   if (negative)
+      bits |= typename format::bits(1) << (sizeof(bits) * 8 - 1);
+   memcpy(&result, &bits, sizeof(result));
+   return true;
+}
+
+} // namespace eosio
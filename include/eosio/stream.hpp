@@ -115,6 +115,102 @@ struct fixed_buf_stream {
    }
 };
 
+// Writes to contiguous memory. When there isn't room for n more bytes, grow makes room; it may
+// move the memory.
+struct output_stream {
+   char* begin = nullptr;
+   char* pos = nullptr;
+   char* end = nullptr;
+   void (*grow)(output_stream& s, size_t n) = nullptr;
+
+   size_t size() const { return pos - begin; }
+
+   void write(char c) {
+      if (pos == end)
+         grow(*this, 1);
+      *pos++ = c;
+   }
+   void write(const void* src, size_t n) {
+      if (size_t(end - pos) < n)
+         grow(*this, n);
+      if (n)
+         memcpy(pos, src, n);
+      pos += n;
+   }
+   template <typename T>
+   void write_raw(const T& v) {
+      write(&v, sizeof(v));
+   }
+
+   // Makes room for n more bytes, so writing them won't grow the stream
+   void reserve(size_t n) {
+      if (size_t(end - pos) < n)
+         grow(*this, n);
+   }
+
+   // Makes room for n bytes at offset by moving the bytes after it. Returns a pointer to the room.
+   char* insert(size_t offset, size_t n) {
+      if (size_t(end - pos) < n)
+         grow(*this, n);
+      char* p = begin + offset;
+      memmove(p + n, p, pos - p);
+      pos += n;
+      return p;
+   }
+};
+
+// Appends to a std::vector<char> or std::string. The container has spare bytes at the end until
+// finish() trims them. Growing zero-fills the new bytes, so it starts from the container's size
+// rather than its capacity; otherwise a reused container would clear all of its old capacity on
+// every use.
+template <typename C>
+struct container_output : output_stream {
+   C& data;
+
+   explicit container_output(C& data) : data{data} {
+      auto used = data.size();
+      data.resize(used + 64);
+      set(used);
+      grow = [](output_stream& s, size_t n) {
+         auto& self = static_cast<container_output&>(s);
+         auto used = self.size();
+         self.data.resize(std::max(used + n, self.data.size() * 2));
+         self.set(used);
+      };
+   }
+
+   void set(size_t used) {
+      begin = data.data();
+      pos = begin + used;
+      end = begin + data.size();
+   }
+
+   void finish() { data.resize(size()); }
+};
+
+// Writes to a caller's buffer. If the output doesn't fit, it continues in overflow instead, so
+// size() is always the full size.
+struct buffer_output : output_stream {
+   std::vector<char> overflow;
+   bool overflowed = false;
+
+   buffer_output(char* buf, size_t buf_size) {
+      begin = pos = buf;
+      end = buf + buf_size;
+      grow = [](output_stream& s, size_t n) {
+         auto& self = static_cast<buffer_output&>(s);
+         auto used = self.size();
+         if (!self.overflowed)
+            self.overflow.assign(self.begin, self.pos);
+         self.overflowed = true;
+         self.overflow.resize(std::max(used + n, self.overflow.size() * 2));
+         self.begin = self.overflow.data();
+         self.pos = self.begin + used;
+         self.end = self.begin + self.overflow.size();
+      };
+   }
+};
+
 struct size_stream {
    size_t size = 0;
 
@@ -169,7 +169,8 @@ EOSIO_COMPARE(symbol_code);
 
 template <typename S>
 void to_json(const symbol_code& obj, S& stream) {
-   to_json(symbol_code_to_string(obj.value), stream);
+   char buf[max_symbol_code_chars];
+   to_json(std::string_view{ buf, symbol_code_to_chars(obj.value, buf) }, stream);
 }
 
 template <typename S>
@@ -247,7 +248,8 @@ EOSIO_COMPARE(symbol);
 
 template <typename S>
 void to_json(const symbol& obj, S& stream) {
-   to_json(symbol_to_string(obj.value), stream);
+   char buf[max_symbol_chars];
+   to_json(std::string_view{ buf, symbol_to_chars(obj.value, buf) }, stream);
 }
 
 template <typename S>
@@ -3,6 +3,7 @@
 #include <cmath>
 #include "for_each_field.hpp"
 #include "fpconv.h"
+#include "hex.hpp"
 #include "stream.hpp"
 #include "types.hpp"
 #include <limits>
@@ -10,9 +11,11 @@
 #include <rapidjson/encodings.h>
 #include <variant>
 
-namespace eosio {
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
 
-inline constexpr char hex_digits[] = "0123456789ABCDEF";
+namespace eosio {
 
 // Adaptors for rapidjson
 struct stream_adaptor {
@@ -27,17 +30,48 @@ struct stream_adaptor {
    int  idx = 0;
 };
 
+// Whether c must be escaped in a json string
+inline bool json_escaped(unsigned char c) { return c == '"' || c == '\\' || c < 32 || c == 127; }
+
+// Returns the end of the run at begin which is printable ascii other than '"' and '\\'. Those
+// bytes need neither validation nor escaping.
+inline const char* skip_plain_ascii(const char* begin, const char* end) {
+#if defined(__SSE2__)
+   while (end - begin >= 16) {
+      __m128i  x     = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+      __m128i  other = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')),
+                                    _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\\')), _mm_cmpeq_epi8(x, _mm_set1_epi8(127))));
+      // Signed, so this also excludes bytes >= 0x80
+      __m128i  plain = _mm_andnot_si128(other, _mm_cmpgt_epi8(x, _mm_set1_epi8(31)));
+      unsigned mask  = ~unsigned(_mm_movemask_epi8(plain)) & 0xffff;
+      if (mask)
+         return begin + __builtin_ctz(mask);
+      begin += 16;
+   }
+#endif
+   while (begin != end && (unsigned char)(*begin) < 128 && !json_escaped(*begin)) ++begin;
+   return begin;
+}
+
 // Replaces any invalid utf-8 bytes with ?
 template <typename S>
 void to_json(std::string_view sv, S& stream) {
    stream.write('"');
-   auto begin = sv.begin();
-   auto end   = sv.end();
-   while (begin != end) {
-      auto pos = begin;
-      while (pos != end && *pos != '"' && *pos != '\\' && (unsigned char)(*pos) >= 32 && *pos != 127) ++pos;
-      while (begin != pos) {
-         stream_adaptor s2(begin, static_cast<std::size_t>(pos - begin));
+   auto begin = sv.data();
+   auto end   = begin + sv.size();
+   while (true) {
+      auto pos = skip_plain_ascii(begin, end);
+      if (pos != begin) {
+         stream.write(begin, pos - begin);
+         begin = pos;
+      }
+      if (begin == end)
+         break;
+      if ((unsigned char)(*begin) >= 128) {
+         // A sequence can't run past the next byte which needs escaping
+         size_t size = 1;
+         while (size < 4 && size < size_t(end - begin) && !json_escaped(begin[size])) ++size;
+         stream_adaptor s2(begin, size);
          if (rapidjson::UTF8<>::Validate(s2, s2)) {
             stream.write(begin, s2.idx);
             begin += s2.idx;
@@ -45,8 +79,7 @@ void to_json(std::string_view sv, S& stream) {
             ++begin;
             stream.write('?');
          }
-      }
-      if (begin != end) {
+      } else {
          if (*begin == '"') {
             stream.write("\\\"", 2);
          } else if (*begin == '\\') {
@@ -238,10 +271,13 @@ void to_json(const T& t, S& stream) {
 template <typename S>
 void to_json_hex(const char* data, size_t size, S& stream) {
    stream.write('"');
-   for (size_t i = 0; i < size; ++i) {
-      unsigned char byte = data[i];
-      stream.write(hex_digits[byte >> 4]);
-      stream.write(hex_digits[byte & 15]);
+   char buf[512];
+   while (size) {
+      size_t n = std::min(size, sizeof(buf) / 2);
+      hex_encode(buf, data, n);
+      stream.write(buf, 2 * n);
+      data += n;
+      size -= n;
    }
    stream.write('"');
 }
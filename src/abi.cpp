@@ -1,6 +1,9 @@
 #include <eosio/abi.hpp>
 #include "abieos.hpp"
 
+#include <cstring>
+#include <set>
+
 using namespace eosio;
 
 namespace {
@@ -29,7 +32,7 @@ struct abi_serializer_impl : abi_serializer {
 template <typename T>
 constexpr auto abi_serializer_for = abi_serializer_impl<T>{};
 
-abi_type::alias resolve(std::map<std::string, abi_type>& abi_types, const abi_type::alias_def* type, int depth);
+abi_type::alias resolve(interned_map<abi_type>& abi_types, const abi_type::alias_def* type, int depth);
 
 template<typename... T, typename... A>
 bool holds_any_alternative(const std::variant<A...>& v) {
@@ -75,7 +78,250 @@ constexpr void for_each_abi_type(F f) {
     f((asset*)nullptr);
 }
 
-abi_type* get_type(std::map<std::string, abi_type>& abi_types,
+bool builtin_opcode(const abi_type& type, bin_to_json_opcode& result) {
+    uint8_t i = 0;
+    bool found = false;
+    for_each_abi_type([&](auto* p) {
+        if (type.ser == &abi_serializer_for<std::decay_t<decltype(*p)>>) {
+            result = bin_to_json_opcode(i);
+            found = true;
+        }
+        ++i;
+    });
+    return found;
+}
+
+// Adds the instructions which convert a value of type. Returns false if type is a builtin abieos doesn't know.
+bool compile_value(std::vector<bin_to_json_op>& program, const abi_type* type, bool keep_allow_extensions) {
+    if (std::holds_alternative<abi_type::builtin>(type->_data)) {
+        bin_to_json_opcode code;
+        if (!builtin_opcode(*type, code))
+            return false;
+        program.push_back({code});
+    } else if (auto* t = type->optional_of()) {
+        auto pos = program.size();
+        program.push_back({bin_to_json_opcode::optional});
+        if (!compile_value(program, t, keep_allow_extensions))
+            return false;
+        program[pos].arg = program.size() - pos - 1;
+    } else if (auto* t = type->extension_of()) {
+        return compile_value(program, t, keep_allow_extensions);
+    } else {
+        program.push_back({bin_to_json_opcode::call, keep_allow_extensions, 0, type});
+    }
+    return true;
+}
+
+constexpr uint32_t unbounded_bin_size = abi_type::unbounded_bin_size;
+
+// min and max binary sizes of the builtins, in the same order as for_each_abi_type
+constexpr std::pair<uint32_t, uint32_t> builtin_bin_sizes[] = {
+    {1, 1},                        // bool
+    {1, 1},                        // int8
+    {1, 1},                        // uint8
+    {2, 2},                        // int16
+    {2, 2},                        // uint16
+    {4, 4},                        // int32
+    {4, 4},                        // uint32
+    {8, 8},                        // int64
+    {8, 8},                        // uint64
+    {16, 16},                      // int128
+    {16, 16},                      // uint128
+    {1, 5},                        // varuint32
+    {1, 5},                        // varint32
+    {4, 4},                        // float32
+    {8, 8},                        // float64
+    {16, 16},                      // float128
+    {8, 8},                        // time_point
+    {4, 4},                        // time_point_sec
+    {4, 4},                        // block_timestamp
+    {8, 8},                        // name
+    {1, unbounded_bin_size},       // bytes
+    {1, unbounded_bin_size},       // string
+    {20, 20},                      // checksum160
+    {32, 32},                      // checksum256
+    {64, 64},                      // checksum512
+    {34, unbounded_bin_size},      // public_key
+    {33, 33},                      // private_key
+    {66, unbounded_bin_size},      // signature
+    {8, 8},                        // symbol
+    {8, 8},                        // symbol_code
+    {16, 16},                      // asset
+};
+static_assert(std::size(builtin_bin_sizes) == size_t(bin_to_json_opcode::asset) + 1);
+
+// Typical json sizes of the builtins' smallest values, and json bytes per binary byte past that, in
+// the same order as for_each_abi_type
+constexpr std::pair<uint32_t, float> builtin_json_sizes[] = {
+    {5, 0},                        // bool
+    {4, 0},                        // int8
+    {3, 0},                        // uint8
+    {6, 0},                        // int16
+    {5, 0},                        // uint16
+    {11, 0},                       // int32
+    {10, 0},                       // uint32
+    {14, 0},                       // int64
+    {14, 0},                       // uint64
+    {24, 0},                       // int128
+    {24, 0},                       // uint128
+    {3, 3},                        // varuint32
+    {3, 3},                        // varint32
+    {14, 0},                       // float32
+    {22, 0},                       // float64
+    {34, 0},                       // float128
+    {26, 0},                       // time_point
+    {21, 0},                       // time_point_sec
+    {25, 0},                       // block_timestamp
+    {14, 0},                       // name
+    {2, 2},                        // bytes
+    {2, 1},                        // string
+    {42, 0},                       // checksum160
+    {66, 0},                       // checksum256
+    {130, 0},                      // checksum512
+    {55, 1.5},                     // public_key
+    {53, 0},                       // private_key
+    {103, 1.5},                    // signature
+    {10, 0},                       // symbol
+    {7, 0},                        // symbol_code
+    {20, 0},                       // asset
+};
+static_assert(std::size(builtin_json_sizes) == std::size(builtin_bin_sizes));
+
+uint32_t add_bin_size(uint32_t a, uint32_t b) { return a >= unbounded_bin_size - b ? unbounded_bin_size : a + b; }
+
+// Fills type's bin size bounds. A type which contains itself gets conservative bounds for the
+// recursive part.
+void compute_bin_size(abi_type& type, std::set<const abi_type*>& visiting) {
+    if (type.bin_size_known || !visiting.insert(&type).second)
+        return;
+    // Types are only reachable as const, but belong to the abi being built
+    auto child = [&](const abi_type* t) -> const abi_type& {
+        compute_bin_size(const_cast<abi_type&>(*t), visiting);
+        return *t;
+    };
+    // json bytes per binary byte of a child's whole value, for containers whose extra bytes are
+    // whole children
+    auto density = [](const abi_type& t) {
+        return std::max(t.json_per_extra_bin_byte, t.min_bin_size ? float(t.min_json_size) / t.min_bin_size : 0);
+    };
+    uint32_t min = 0, max = unbounded_bin_size, min_json = 0;
+    float extra_json = 2;
+    if (std::holds_alternative<abi_type::builtin>(type._data)) {
+        bin_to_json_opcode code;
+        if (builtin_opcode(type, code)) {
+            std::tie(min, max) = builtin_bin_sizes[size_t(code)];
+            std::tie(min_json, extra_json) = builtin_json_sizes[size_t(code)];
+        }
+    } else if (auto* t = type.optional_of()) {
+        auto& o = child(t);
+        min = 1;
+        max = add_bin_size(1, o.max_bin_size);
+        min_json = 4;
+        extra_json = density(o);
+    } else if (auto* t = type.extension_of()) {
+        auto& e = child(t);
+        max = e.max_bin_size;
+        extra_json = density(e);
+    } else if (auto* t = type.array_of()) {
+        auto& e = child(t);
+        min = 1;
+        min_json = 2;
+        extra_json = density(e) + (e.min_bin_size ? 1.0f / e.min_bin_size : 1);
+    } else if (auto* s = type.as_struct()) {
+        max = 0;
+        min_json = 2;
+        extra_json = 0;
+        for (auto& field : s->fields) {
+            auto& f = child(field.type);
+            min = add_bin_size(min, f.min_bin_size);
+            max = add_bin_size(max, f.max_bin_size);
+            min_json = add_bin_size(min_json, add_bin_size(uint32_t(field.name.size()) + 4, f.min_json_size));
+            extra_json = std::max(extra_json, f.json_per_extra_bin_byte);
+        }
+    } else if (auto* v = type.as_variant(); v && !v->empty()) {
+        min = unbounded_bin_size;
+        max = 0;
+        min_json = unbounded_bin_size;
+        extra_json = 0;
+        for (auto& alternative : *v) {
+            auto& a = child(alternative.type);
+            min = std::min(min, a.min_bin_size);
+            max = std::max(max, a.max_bin_size);
+            min_json = std::min(min_json, add_bin_size(uint32_t(alternative.name.size()) + 5, a.min_json_size));
+            extra_json = std::max(extra_json, density(a));
+        }
+        // The tag is a varuint32, which may be padded to 5 bytes
+        min = add_bin_size(1, min);
+        max = add_bin_size(5, max);
+    } else if (!type.as_variant()) {
+        // not resolved yet
+        visiting.erase(&type);
+        return;
+    }
+    visiting.erase(&type);
+    type.min_bin_size = min;
+    type.max_bin_size = max;
+    type.min_json_size = min_json;
+    type.json_per_extra_bin_byte = extra_json;
+    type.bin_size_known = true;
+}
+
+// Fills type.bin_to_json_program. Called once type is resolved; the types it refers to may be
+// compiled later.
+void compile_program(abi_type& type) {
+    using op = bin_to_json_opcode;
+    std::vector<bin_to_json_op> program;
+    if (auto* s = type.as_struct()) {
+        program.push_back({op::begin_object});
+        for (auto& field : s->fields) {
+            auto pos = program.size();
+            program.push_back({&field == &s->fields.front() ? op::first_field : op::field});
+            program[pos].field = &field;
+            if (!compile_value(program, field.type, &field == &s->fields.back()))
+                return;
+            program[pos].arg = program.size() - pos - 1;
+        }
+        program.push_back({op::end_object});
+    } else if (auto* element = type.array_of()) {
+        program.push_back({op::begin_array});
+        program.push_back({op::array_item});
+        if (!compile_value(program, element, false))
+            return;
+        program.push_back({op::jump, false, 1 - int32_t(program.size())});
+        program[1].arg = program.size() - 1;
+        program.push_back({op::end_array});
+    } else if (auto* v = type.as_variant()) {
+        program.push_back({op::variant, false, int32_t(v->size()), &type});
+        program.resize(1 + v->size(), {op::jump});
+        std::vector<size_t> jumps_to_end;
+        for (size_t i = 0; i < v->size(); ++i) {
+            program[1 + i].arg = program.size() - (1 + i);
+            if (!compile_value(program, (*v)[i].type, true))
+                return;
+            jumps_to_end.push_back(program.size());
+            program.push_back({op::jump});
+        }
+        for (auto pos : jumps_to_end)
+            program[pos].arg = program.size() - pos;
+        program.push_back({op::end_variant});
+    } else if (holds_any_alternative<abi_type::builtin, abi_type::optional, abi_type::extension>(type._data)) {
+        if (!compile_value(program, &type, true))
+            return;
+        program.push_back({op::ret});
+    } else {
+        return;
+    }
+    type.bin_to_json_program = std::move(program);
+}
+
+void compile(abi_type& type) {
+    compile_program(type);
+    type.index_alternatives();
+    std::set<const abi_type*> visiting;
+    compute_bin_size(type, visiting);
+}
+
+abi_type* get_type(interned_map<abi_type>& abi_types,
                            const std::string& name, int depth) {
    eosio::check(depth < 32,
         eosio::convert_abi_error(abi_error::recursion_limit_reached));
@@ -85,19 +331,22 @@ abi_type* get_type(std::map<std::string, abi_type>& abi_types,
             auto base = get_type(abi_types, name.substr(0, name.size() - 1), depth + 1);
             eosio::check(!holds_any_alternative<abi_type::optional, abi_type::array, abi_type::extension>(base->_data),
                   eosio::convert_abi_error(abi_error::invalid_nesting));
-            auto [iter, success] = abi_types.try_emplace(name, name, abi_type::optional{base}, &abi_serializer_for< ::abieos::pseudo_optional>);
+            auto [iter, success] = abi_types.try_emplace(name, abi_type::optional{base}, &abi_serializer_for< ::abieos::pseudo_optional>);
+            compile(iter->second);
             return &iter->second;
         } else if (ends_with(name, "[]")) {
             auto element = get_type(abi_types, name.substr(0, name.size() - 2), depth + 1);
             eosio::check(!holds_any_alternative<abi_type::optional, abi_type::array, abi_type::extension>(element->_data),
                   eosio::convert_abi_error(abi_error::invalid_nesting));
-            auto [iter, success] = abi_types.try_emplace(name, name, abi_type::array{element}, &abi_serializer_for< ::abieos::pseudo_array>);
+            auto [iter, success] = abi_types.try_emplace(name, abi_type::array{element}, &abi_serializer_for< ::abieos::pseudo_array>);
+            compile(iter->second);
             return &iter->second;
         } else if (ends_with(name, "$")) {
             auto base = get_type(abi_types, name.substr(0, name.size() - 1), depth + 1);
             eosio::check(!std::holds_alternative<abi_type::extension>(base->_data),
                   eosio::convert_abi_error(abi_error::invalid_nesting));
-            auto [iter, success] = abi_types.try_emplace(name, name, abi_type::extension{base}, &abi_serializer_for< ::abieos::pseudo_extension>);
+            auto [iter, success] = abi_types.try_emplace(name, abi_type::extension{base}, &abi_serializer_for< ::abieos::pseudo_extension>);
+            compile(iter->second);
             return &iter->second;
         } else
            eosio::check(false, eosio::convert_abi_error(abi_error::unknown_type));
@@ -115,7 +364,7 @@ abi_type* get_type(std::map<std::string, abi_type>& abi_types,
     return &it->second;
 }
 
-abi_type::struct_ resolve(std::map<std::string, abi_type>& abi_types, const struct_def* type, int depth) {
+abi_type::struct_ resolve(interned_map<abi_type>& abi_types, const struct_def* type, int depth) {
    eosio::check(depth < 32,
         eosio::convert_abi_error(abi_error::recursion_limit_reached));
     abi_type::struct_ result;
@@ -134,24 +383,25 @@ abi_type::struct_ resolve(std::map<std::string, abi_type>& abi_types, const stru
     }
     for (auto& field : type->fields) {
         auto t = get_type(abi_types, field.type, depth + 1);
-        result.fields.push_back(abi_field{field.name, t});
+        result.fields.push_back(
+            abi_field{abi_types.intern(field.name), t, abi_types.intern(json_key(',', field.name, ':'))});
     }
     return result;
 }
 
 
-abi_type::variant resolve(std::map<std::string, abi_type>& abi_types, const variant_def* type, int depth) {
+abi_type::variant resolve(interned_map<abi_type>& abi_types, const variant_def* type, int depth) {
    eosio::check(depth < 32,
         eosio::convert_abi_error(abi_error::recursion_limit_reached));
     abi_type::variant result;
     for (const std::string& field : type->types) {
         auto t = get_type(abi_types, field, depth + 1);
-        result.push_back({field, t});
+        result.push_back({abi_types.intern(field), t, abi_types.intern(json_key('[', field, ','))});
     }
     return result;
 }
 
-abi_type::alias resolve(std::map<std::string, abi_type>& abi_types, const abi_type::alias_def* type, int depth) {
+abi_type::alias resolve(interned_map<abi_type>& abi_types, const abi_type::alias_def* type, int depth) {
     auto t = get_type(abi_types, *type, depth + 1);
     eosio::check(!std::holds_alternative<abi_type::extension>(t->_data),
         eosio::convert_abi_error(abi_error::extension_typedef));
@@ -159,7 +409,7 @@ abi_type::alias resolve(std::map<std::string, abi_type>& abi_types, const abi_ty
 }
 
 struct fill_t {
-   std::map<std::string, abi_type>& abi_types;
+   interned_map<abi_type>& abi_types;
    abi_type& type;
    int depth;
    template<typename T>
@@ -172,74 +422,308 @@ struct fill_t {
    }
 };
 
-void fill(std::map<std::string, abi_type>& abi_types, abi_type& type, int depth) {
+void fill(interned_map<abi_type>& abi_types, abi_type& type, int depth) {
    return std::visit(fill_t{abi_types, type, depth}, type._data);
 }
 
 }
 
 
+namespace {
+
+// Resolves type and every type it refers to which isn't closed yet, then compiles them. Nothing
+// is marked closed unless everything resolves.
+void close_type(interned_map<abi_type>& abi_types, abi_type& type) {
+    std::vector<abi_type*> pending{&type}, reached;
+    std::set<abi_type*> seen;
+    auto add = [&](const abi_type* t) { pending.push_back(const_cast<abi_type*>(t)); };
+    while (!pending.empty()) {
+        auto* t = pending.back();
+        pending.pop_back();
+        if (t->closed || !seen.insert(t).second)
+            continue;
+        fill(abi_types, *t, 0);
+        reached.push_back(t);
+        if (auto* a = std::get_if<abi_type::alias>(&t->_data))
+            add(a->type);
+        else if (auto* o = t->optional_of())
+            add(o);
+        else if (auto* e = t->extension_of())
+            add(e);
+        else if (auto* a = t->array_of())
+            add(a);
+        else if (auto* s = t->as_struct())
+            for (auto& field : s->fields)
+                add(field.type);
+        else if (auto* v = t->as_variant())
+            for (auto& alternative : *v)
+                add(alternative.type);
+    }
+    // Programs and sizes computed while the types they refer to were unresolved are stale
+    for (auto* t : reached) {
+        t->bin_to_json_program.clear();
+        t->bin_size_known = false;
+    }
+    for (auto* t : reached)
+        compile(*t);
+    for (auto* t : reached)
+        t->closed = true;
+}
+
+} // namespace
+
 const abi_type* eosio::abi::get_type(const std::string& name) {
-   return ::get_type(abi_types, name, 0);
+   auto* type = ::get_type(abi_types, name, 0);
+   if (!type->closed) {
+      if (lazy_def)
+         close_type(abi_types, *type);
+      else
+         type->closed = true;
+   }
+   return type;
 }
 
-void eosio::convert(const abi_def& abi, eosio::abi& c) {
+const abi_type* eosio::abi::find_type(std::string_view name) const {
+   auto it = abi_types.find(name);
+   if (it == abi_types.end())
+      return nullptr;
+   const abi_type* type = &it->second;
+   if (auto* alias = std::get_if<abi_type::alias>(&type->_data))
+      type = alias->type;
+   if (holds_any_alternative<const abi_type::alias_def*, const struct_def*, const variant_def*>(type->_data))
+      return nullptr;
+   if (lazy_def && !type->closed)
+      return nullptr;
+   return type;
+}
+
+namespace {
+
+std::string_view base_type_name(std::string_view name) {
+    while (true) {
+        if (name.size() >= 2 && name.substr(name.size() - 2) == "[]")
+            name.remove_suffix(2);
+        else if (!name.empty() && (name.back() == '?' || name.back() == '$'))
+            name.remove_suffix(1);
+        else
+            return name;
+    }
+}
+
+struct def_index {
+    std::map<std::string_view, const type_def*> types;
+    std::map<std::string_view, const struct_def*> structs;
+    std::map<std::string_view, const variant_def*> variants;
+
+    explicit def_index(const abi_def& def) {
+        for (auto& t : def.types)
+            types.try_emplace(t.new_type_name, &t);
+        for (auto& s : def.structs)
+            structs.try_emplace(s.name, &s);
+        for (auto& v : def.variants.value)
+            variants.try_emplace(v.name, &v);
+    }
+
+    template <typename M>
+    static auto find(const M& m, std::string_view name) -> typename M::mapped_type {
+        auto it = m.find(name);
+        return it == m.end() ? nullptr : it->second;
+    }
+
+    // Whether name has the same definition in both indexes. Types which neither
+    // defines (builtins) are the same.
+    static bool same_definition(const def_index& a, const def_index& b, std::string_view name) {
+        auto *at = find(a.types, name), *bt = find(b.types, name);
+        auto *as = find(a.structs, name), *bs = find(b.structs, name);
+        auto *av = find(a.variants, name), *bv = find(b.variants, name);
+        if (!at != !bt || !as != !bs || !av != !bv)
+            return false;
+        if (at && at->type != bt->type)
+            return false;
+        if (as) {
+            if (as->base != bs->base || as->fields.size() != bs->fields.size())
+                return false;
+            for (size_t i = 0; i < as->fields.size(); ++i)
+                if (as->fields[i].name != bs->fields[i].name || as->fields[i].type != bs->fields[i].type)
+                    return false;
+        }
+        if (av && av->types != bv->types)
+            return false;
+        return true;
+    }
+
+    template <typename F>
+    void for_each_dependency(std::string_view name, F f) const {
+        if (auto* t = find(types, name))
+            f(base_type_name(t->type));
+        if (auto* s = find(structs, name)) {
+            if (!s->base.empty())
+                f(base_type_name(s->base));
+            for (auto& field : s->fields)
+                f(base_type_name(field.type));
+        }
+        if (auto* v = find(variants, name))
+            for (auto& type : v->types)
+                f(base_type_name(type));
+    }
+};
+
+// Finds the types which def may share with prev_def. A type is unchanged if its definition
+// is identical and every type it refers to, directly or indirectly, is also unchanged.
+std::set<std::string_view> unchanged_types(const abi_def& def, const abi_def& prev_def) {
+    def_index current{def}, prev{prev_def};
+    std::map<std::string_view, std::vector<std::string_view>> dependents;
+    std::set<std::string_view> candidates, changed;
+    std::vector<std::string_view> work;
+    auto add = [&](const auto& m) {
+        for (auto& [name, _] : m) {
+            current.for_each_dependency(name, [&](std::string_view dep) { dependents[dep].push_back(name); });
+            if (def_index::same_definition(current, prev, name))
+                candidates.insert(name);
+            else if (changed.insert(name).second)
+                work.push_back(name);
+        }
+    };
+    add(current.types);
+    add(current.structs);
+    add(current.variants);
+    for (auto& [name, _] : dependents) {
+        if (!current.types.count(name) && !current.structs.count(name) && !current.variants.count(name) &&
+            !def_index::same_definition(current, prev, name) && changed.insert(name).second)
+            work.push_back(name);
+    }
+    while (!work.empty()) {
+        auto name = work.back();
+        work.pop_back();
+        auto it = dependents.find(name);
+        if (it == dependents.end())
+            continue;
+        for (auto dependent : it->second)
+            if (changed.insert(dependent).second)
+                work.push_back(dependent);
+    }
+    for (auto name : changed)
+        candidates.erase(name);
+    return candidates;
+}
+
+// An action or table may name a type the abi doesn't define; that's only an error if it's used
+void resolve_named_types(eosio::abi& c, const std::map<name, std::string>& types,
+                         std::unordered_map<uint64_t, const abi_type*>& result) {
+    for (auto& [n, type] : types) {
+        try {
+            result[n.value] = c.get_type(type);
+        } catch (std::exception&) {
+        }
+    }
+}
+
+void convert(const abi_def& abi, eosio::abi& c, const std::set<std::string_view>& unchanged, const eosio::abi* prev,
+             bool lazy) {
+    // The shared type is fully resolved and never modified again
+    auto try_share = [&](const std::string& name) {
+        if (!prev || !unchanged.count(name))
+            return false;
+        auto* type = prev->find_type(name);
+        if (!type)
+            return false;
+        auto [_, inserted] = c.abi_types.try_emplace(name, abi_type::alias{const_cast<abi_type*>(type)}, nullptr);
+        eosio::check(inserted, eosio::convert_abi_error(abi_error::redefined_type));
+        return true;
+    };
     for (auto& a : abi.actions)
         c.action_types[a.name] = a.type;
     for (auto& t : abi.tables)
         c.table_types[t.name] = t.type;
     for_each_abi_type([&](auto* p) {
         const char* name = get_type_name(p);
-        c.abi_types.try_emplace(name, name, abi_type::builtin{}, &abi_serializer_for<std::decay_t<decltype(*p)>>);
+        c.abi_types.try_emplace(name, abi_type::builtin{}, &abi_serializer_for<std::decay_t<decltype(*p)>>);
     });
     {
-        c.abi_types.try_emplace("extended_asset", "extended_asset",
-                                abi_type::struct_{nullptr, {{"quantity", &c.abi_types.find("asset")->second},
-                                                            {"contract", &c.abi_types.find("name")->second}}},
+        c.abi_types.try_emplace("extended_asset",
+                                abi_type::struct_{nullptr, {{"quantity", &c.abi_types.find("asset")->second,
+                                                             ",\"quantity\":"},
+                                                            {"contract", &c.abi_types.find("name")->second,
+                                                             ",\"contract\":"}}},
                                 &abi_serializer_for<::abieos::pseudo_object>);
     }
 
     for (auto& t : abi.types) {
        eosio::check(!t.new_type_name.empty(),
             eosio::convert_abi_error(abi_error::missing_name));
-        auto [_, inserted] = c.abi_types.try_emplace(t.new_type_name, t.new_type_name, &t.type, nullptr);
+        if (try_share(t.new_type_name))
+            continue;
+        auto [_, inserted] = c.abi_types.try_emplace(t.new_type_name, &t.type, nullptr);
         eosio::check(inserted,
             eosio::convert_abi_error(abi_error::redefined_type));
     }
     for (auto& s : abi.structs) {
        eosio::check(!s.name.empty(),
             eosio::convert_abi_error(abi_error::missing_name));
-        auto [it, inserted] = c.abi_types.try_emplace(s.name, s.name, &s, &abi_serializer_for<::abieos::pseudo_object>);
+        if (try_share(s.name))
+            continue;
+        auto [it, inserted] = c.abi_types.try_emplace(s.name, &s, &abi_serializer_for<::abieos::pseudo_object>);
         eosio::check(inserted,
             eosio::convert_abi_error(abi_error::redefined_type));
     }
     for (auto& v : abi.variants.value) {
        eosio::check(!v.name.empty(),
             eosio::convert_abi_error(abi_error::missing_name));
-        auto [it, inserted] = c.abi_types.try_emplace(v.name, v.name, &v, &abi_serializer_for<::abieos::pseudo_variant>);
+        if (try_share(v.name))
+            continue;
+        auto [it, inserted] = c.abi_types.try_emplace(v.name, &v, &abi_serializer_for<::abieos::pseudo_variant>);
         eosio::check(inserted,
             eosio::convert_abi_error(abi_error::redefined_type));
     }
+    if (lazy)
+        return;
+    // fill adds derived types, which invalidates iterators
+    for (size_t i = 0; i < c.abi_types.size(); ++i) {
+        fill(c.abi_types, c.abi_types.begin()[i].second, 0);
+    }
     for (auto& [_, t] : c.abi_types) {
-        fill(c.abi_types, t, 0);
+        if (t.bin_to_json_program.empty())
+            compile(t);
+        t.closed = true;
     }
+    resolve_named_types(c, c.action_types, c.resolved_action_types);
+    resolve_named_types(c, c.table_types, c.resolved_table_types);
 }
 
-void to_abi_def(abi_def& def, const std::string& name, const abi_type::builtin&) {}
-void to_abi_def(abi_def& def, const std::string& name, const abi_type::optional&) {}
-void to_abi_def(abi_def& def, const std::string& name, const abi_type::array&) {}
-void to_abi_def(abi_def& def, const std::string& name, const abi_type::extension&) {}
+} // namespace
 
-template<typename T>
-void to_abi_def(abi_def& def, const std::string& name, const T*) {
-   eosio::check(false, eosio::convert_abi_error(eosio::abi_error::bad_abi));
+void eosio::convert(const abi_def& abi, eosio::abi& c) {
+    ::convert(abi, c, {}, nullptr, false);
+}
+
+void eosio::convert(const abi_def& def, eosio::abi& c, const abi_def& prev_def, std::shared_ptr<const eosio::abi> prev) {
+    ::convert(def, c, unchanged_types(def, prev_def), prev.get(), false);
+    c.previous = std::move(prev);
 }
 
-void to_abi_def(abi_def& def, const std::string& name, const abi_type::alias& alias) {
-   def.types.push_back({name, alias.type->name});
+void eosio::convert_lazy(std::shared_ptr<const abi_def> def, eosio::abi& c) {
+    ::convert(*def, c, {}, nullptr, true);
+    c.lazy_def = std::move(def);
 }
 
-void to_abi_def(abi_def& def, const std::string& name, const abi_type::struct_& struct_) {
+void eosio::convert_lazy(std::shared_ptr<const abi_def> def, eosio::abi& c, const abi_def& prev_def,
+                         std::shared_ptr<const eosio::abi> prev) {
+    ::convert(*def, c, unchanged_types(*def, prev_def), prev.get(), true);
+    c.lazy_def = std::move(def);
+    c.previous = std::move(prev);
+}
+
+void to_abi_def(abi_def& def, std::string_view name, const abi_type::builtin&) {}
+void to_abi_def(abi_def& def, std::string_view name, const abi_type::optional&) {}
+void to_abi_def(abi_def& def, std::string_view name, const abi_type::array&) {}
+void to_abi_def(abi_def& def, std::string_view name, const abi_type::extension&) {}
+
+template<typename T>
+void to_abi_def(abi_def& def, std::string_view name, const T*) {
+   eosio::check(false, eosio::convert_abi_error(eosio::abi_error::bad_abi));
+}
+
+void to_abi_def(abi_def& def, std::string_view name, const abi_type::struct_& struct_) {
    if(name == "extended_asset") return;
    std::size_t field_offset = 0;
    std::string base;
@@ -250,17 +734,25 @@ void to_abi_def(abi_def& def, const std::string& name, const abi_type::struct_&
    }
    for(std::size_t i = field_offset; i < struct_.fields.size(); ++i) {
       const abi_field& field = struct_.fields[i];
-      fields.push_back({field.name, field.type->name});
+      fields.push_back({std::string{field.name}, std::string{field.type->name}});
    }
-   def.structs.push_back({name, std::move(base), std::move(fields)});
+   def.structs.push_back({std::string{name}, std::move(base), std::move(fields)});
 }
 
-void to_abi_def(abi_def& def, const std::string& name, const abi_type::variant& variant) {
+void to_abi_def(abi_def& def, std::string_view name, const abi_type::variant& variant) {
    std::vector<std::string> types;
-   for(const auto& [name, type] : variant) {
-      types.push_back(type->name);
+   for(const auto& alternative : variant) {
+      types.emplace_back(alternative.type->name);
+   }
+   def.variants.value.push_back({std::string{name}, std::move(types)});
+}
+
+void to_abi_def(abi_def& def, std::string_view name, const abi_type::alias& alias) {
+   // Shared with an earlier version of the abi
+   if(alias.type->name == name) {
+      return std::visit([&](const auto& t){ return to_abi_def(def, name, t); }, alias.type->_data);
    }
-   def.variants.value.push_back({name, std::move(types)});
+   def.types.push_back({std::string{name}, std::string{alias.type->name}});
 }
 
 void eosio::convert(const eosio::abi& abi, eosio::abi_def& def) {
@@ -270,6 +762,309 @@ void eosio::convert(const eosio::abi& abi, eosio::abi_def& def) {
    }
 }
 
+namespace {
+
+// An image is a header followed by tables of fixed-size records, then the strings they refer to. Records
+// refer to each other by index and to strings by offset. Loading rebuilds the abi from them, so the image
+// isn't needed afterwards. Integers are in the saving machine's byte order; the header records it and
+// loading rejects an image from a machine with the other order.
+constexpr char image_magic[8] = {'a', 'b', 'i', 'i', 'm', 'g', '0', '1'};
+constexpr uint32_t image_byte_order = 0x0102'0304;
+constexpr uint32_t no_image_index = 0xffff'ffff;
+
+enum class image_kind : uint8_t { builtin, alias, optional, extension, array, struct_, variant };
+
+struct image_header {
+    char     magic[8];
+    uint32_t byte_order;  // image_byte_order
+    uint32_t num_types;
+    uint32_t num_fields;
+    uint32_t num_actions;
+    uint32_t num_tables;
+    uint32_t strings_size;
+};
+
+struct image_string {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct image_type {
+    image_string name;
+    image_kind   kind;
+    uint8_t      builtin;  // bin_to_json_opcode of builtins
+    uint16_t     reserved;
+    uint32_t     target;   // alias, optional, extension, array: the type they refer to. struct_, variant: first field.
+    uint32_t     count;    // struct_, variant: number of fields
+    uint32_t     base;     // struct_: base struct, or no_image_index
+};
+
+struct image_field {
+    image_string name;
+    uint32_t     type;
+};
+
+struct image_named_type {
+    uint64_t     name;
+    image_string type;
+};
+
+template <typename T>
+void append_record(std::vector<char>& image, const T& record) {
+    auto* p = reinterpret_cast<const char*>(&record);
+    image.insert(image.end(), p, p + sizeof(record));
+}
+
+struct image_writer {
+    std::map<std::string_view, const abi_type*> types;
+    std::map<std::string_view, std::string_view> aliases;
+    std::map<std::string_view, uint32_t>         indexes;
+    std::map<std::string_view, uint32_t>         string_offsets;
+    std::string                                  strings;
+
+    // Types which have the same name mean the same thing; an abi which shares types with an earlier
+    // version may refer to both the earlier type and its own derived types (e.g. "x[]").
+    void add(const abi_type* type) {
+        std::vector<const abi_type*> pending{type};
+        while (!pending.empty()) {
+            auto* t = pending.back();
+            pending.pop_back();
+            if (!types.try_emplace(t->name, t).second)
+                continue;
+            if (auto* a = std::get_if<abi_type::alias>(&t->_data))
+                pending.push_back(a->type);
+            else if (auto* o = t->optional_of())
+                pending.push_back(o);
+            else if (auto* e = t->extension_of())
+                pending.push_back(e);
+            else if (auto* a = t->array_of())
+                pending.push_back(a);
+            else if (auto* s = t->as_struct()) {
+                if (s->base)
+                    pending.push_back(s->base);
+                for (auto& field : s->fields)
+                    pending.push_back(field.type);
+            } else if (auto* v = t->as_variant())
+                for (auto& alternative : *v)
+                    pending.push_back(alternative.type);
+        }
+    }
+
+    image_string string(std::string_view s) {
+        auto [it, inserted] = string_offsets.try_emplace(s, strings.size());
+        if (inserted)
+            strings += s;
+        return {it->second, uint32_t(s.size())};
+    }
+
+    uint32_t index(const abi_type* type) { return indexes.at(type->name); }
+};
+
+} // namespace
+
+void eosio::save_image(const eosio::abi& a, std::vector<char>& image) {
+    image_writer w;
+    for (auto& [name, _] : a.abi_types) {
+        if (auto* t = a.find_type(name); t && t->name == name)
+            w.add(t);
+    }
+    for (auto& [name, _] : a.abi_types) {
+        if (auto* t = a.find_type(name); t && t->name != name) {
+            w.add(t);
+            w.aliases.try_emplace(name, t->name);
+        }
+    }
+    for (auto& [name, _] : w.types)
+        w.indexes.try_emplace(name, w.indexes.size());
+    for (auto& [name, _] : w.aliases)
+        w.indexes.try_emplace(name, w.indexes.size());
+
+    std::vector<image_type>  types;
+    std::vector<image_field> fields;
+    auto add_fields = [&](image_type& rec, const std::vector<abi_field>& f) {
+        rec.target = fields.size();
+        rec.count  = f.size();
+        for (auto& field : f)
+            fields.push_back({w.string(field.name), w.index(field.type)});
+    };
+    for (auto& [name, t] : w.types) {
+        image_type rec{w.string(name), image_kind::builtin, 0, 0, no_image_index, 0, no_image_index};
+        if (std::holds_alternative<abi_type::builtin>(t->_data)) {
+            bin_to_json_opcode code;
+            eosio::check(builtin_opcode(*t, code), eosio::convert_abi_error(abi_error::bad_abi));
+            rec.builtin = uint8_t(code);
+        } else if (auto* al = std::get_if<abi_type::alias>(&t->_data)) {
+            rec.kind   = image_kind::alias;
+            rec.target = w.index(al->type);
+        } else if (auto* o = t->optional_of()) {
+            rec.kind   = image_kind::optional;
+            rec.target = w.index(o);
+        } else if (auto* e = t->extension_of()) {
+            rec.kind   = image_kind::extension;
+            rec.target = w.index(e);
+        } else if (auto* ar = t->array_of()) {
+            rec.kind   = image_kind::array;
+            rec.target = w.index(ar);
+        } else if (auto* st = t->as_struct()) {
+            rec.kind = image_kind::struct_;
+            if (st->base)
+                rec.base = w.index(st->base);
+            add_fields(rec, st->fields);
+        } else if (auto* v = t->as_variant()) {
+            rec.kind = image_kind::variant;
+            add_fields(rec, *v);
+        } else {
+            eosio::check(false, eosio::convert_abi_error(abi_error::bad_abi));
+        }
+        types.push_back(rec);
+    }
+    for (auto& [name, target] : w.aliases)
+        types.push_back({w.string(name), image_kind::alias, 0, 0, w.indexes.at(target), 0, no_image_index});
+
+    std::vector<image_named_type> actions, tables;
+    for (auto& [n, type] : a.action_types)
+        actions.push_back({n.value, w.string(type)});
+    for (auto& [n, type] : a.table_types)
+        tables.push_back({n.value, w.string(type)});
+
+    image_header header{};
+    memcpy(header.magic, image_magic, sizeof(image_magic));
+    header.byte_order   = image_byte_order;
+    header.num_types    = types.size();
+    header.num_fields   = fields.size();
+    header.num_actions  = actions.size();
+    header.num_tables   = tables.size();
+    header.strings_size = w.strings.size();
+    image.clear();
+    append_record(image, header);
+    for (auto& rec : types)
+        append_record(image, rec);
+    for (auto& rec : fields)
+        append_record(image, rec);
+    for (auto& rec : actions)
+        append_record(image, rec);
+    for (auto& rec : tables)
+        append_record(image, rec);
+    image.insert(image.end(), w.strings.begin(), w.strings.end());
+}
+
+void eosio::load_image(eosio::abi& c, std::string_view image) {
+    auto bad_image = [] { return eosio::convert_abi_error(abi_error::bad_abi_image); };
+    size_t pos = 0;
+    auto read = [&](auto& record) {
+        eosio::check(image.size() - pos >= sizeof(record), bad_image());
+        memcpy(&record, image.data() + pos, sizeof(record));
+        pos += sizeof(record);
+    };
+    image_header header;
+    read(header);
+    eosio::check(!memcmp(header.magic, image_magic, sizeof(image_magic)), bad_image());
+    eosio::check(header.byte_order == image_byte_order, bad_image());
+    auto read_table = [&](auto& records, uint32_t count) {
+        eosio::check((image.size() - pos) / sizeof(records[0]) >= count, bad_image());
+        records.resize(count);
+        for (auto& rec : records)
+            read(rec);
+    };
+    std::vector<image_type>       types;
+    std::vector<image_field>      fields;
+    std::vector<image_named_type> actions, tables;
+    read_table(types, header.num_types);
+    read_table(fields, header.num_fields);
+    read_table(actions, header.num_actions);
+    read_table(tables, header.num_tables);
+    eosio::check(image.size() - pos == header.strings_size, bad_image());
+    auto strings = image.substr(pos);
+    auto str     = [&](image_string s) {
+        eosio::check(s.offset <= strings.size() && s.size <= strings.size() - s.offset, bad_image());
+        return strings.substr(s.offset, s.size);
+    };
+
+    std::vector<const abi_serializer*> builtins;
+    for_each_abi_type([&](auto* p) { builtins.push_back(&abi_serializer_for<std::decay_t<decltype(*p)>>); });
+    std::vector<abi_type*> resolved;
+    for (auto& rec : types) {
+        const abi_serializer* ser = nullptr;
+        switch (rec.kind) {
+        case image_kind::builtin:
+            eosio::check(rec.builtin < builtins.size(), bad_image());
+            ser = builtins[rec.builtin];
+            break;
+        case image_kind::alias: break;
+        case image_kind::optional: ser = &abi_serializer_for<::abieos::pseudo_optional>; break;
+        case image_kind::extension: ser = &abi_serializer_for<::abieos::pseudo_extension>; break;
+        case image_kind::array: ser = &abi_serializer_for<::abieos::pseudo_array>; break;
+        case image_kind::struct_: ser = &abi_serializer_for<::abieos::pseudo_object>; break;
+        case image_kind::variant: ser = &abi_serializer_for<::abieos::pseudo_variant>; break;
+        default: eosio::check(false, bad_image());
+        }
+        auto name = str(rec.name);
+        auto [it, inserted] = c.abi_types.try_emplace(name, abi_type::builtin{}, ser);
+        eosio::check(inserted, eosio::convert_abi_error(abi_error::redefined_type));
+        resolved.push_back(&it->second);
+    }
+    // Aliases may only refer to other kinds of types, so find_type never returns an alias
+    auto type_at = [&](uint32_t index, bool allow_alias = false) {
+        eosio::check(index < resolved.size() && (allow_alias || types[index].kind != image_kind::alias),
+                     bad_image());
+        return resolved[index];
+    };
+    auto fields_of = [&](const image_type& rec, char before, char after) {
+        eosio::check(rec.target <= fields.size() && rec.count <= fields.size() - rec.target, bad_image());
+        std::vector<abi_field> result;
+        for (uint32_t i = rec.target; i < rec.target + rec.count; ++i) {
+            auto name = str(fields[i].name);
+            result.push_back({c.abi_types.intern(name), type_at(fields[i].type),
+                              c.abi_types.intern(json_key(before, name, after))});
+        }
+        return result;
+    };
+    // The same nesting rules as get_type
+    auto nested_type_at = [&](uint32_t index, std::initializer_list<image_kind> disallowed) {
+        auto* t = type_at(index);
+        for (auto kind : disallowed)
+            eosio::check(types[index].kind != kind, eosio::convert_abi_error(abi_error::invalid_nesting));
+        return t;
+    };
+    using k = image_kind;
+    for (size_t i = 0; i < types.size(); ++i) {
+        auto& rec  = types[i];
+        auto& type = *resolved[i];
+        switch (rec.kind) {
+        case k::builtin: break;
+        case k::alias: type._data = abi_type::alias{nested_type_at(rec.target, {k::extension})}; break;
+        case k::optional:
+            type._data = abi_type::optional{nested_type_at(rec.target, {k::optional, k::array, k::extension})};
+            break;
+        case k::extension: type._data = abi_type::extension{nested_type_at(rec.target, {k::extension})}; break;
+        case k::array:
+            type._data = abi_type::array{nested_type_at(rec.target, {k::optional, k::array, k::extension})};
+            break;
+        case k::struct_: {
+            abi_type* base = nullptr;
+            if (rec.base != no_image_index) {
+                base = type_at(rec.base);
+                eosio::check(types[rec.base].kind == k::struct_,
+                             eosio::convert_abi_error(abi_error::base_not_a_struct));
+            }
+            type._data = abi_type::struct_{base, fields_of(rec, ',', ':')};
+            break;
+        }
+        case k::variant: type._data = fields_of(rec, '[', ','); break;
+        }
+    }
+    for (auto* t : resolved) {
+        compile(*t);
+        t->closed = true;
+    }
+    for (auto& rec : actions)
+        c.action_types[name{rec.name}] = std::string{str(rec.type)};
+    for (auto& rec : tables)
+        c.table_types[name{rec.name}] = std::string{str(rec.type)};
+    resolve_named_types(c, c.action_types, c.resolved_action_types);
+    resolve_named_types(c, c.table_types, c.resolved_table_types);
+}
+
 const abi_serializer* const eosio::object_abi_serializer = &abi_serializer_for< ::abieos::pseudo_object>;
 const abi_serializer* const eosio::variant_abi_serializer = &abi_serializer_for< ::abieos::pseudo_variant>;
 const abi_serializer* const eosio::array_abi_serializer = &abi_serializer_for< ::abieos::pseudo_array>;
@@ -277,10 +1072,19 @@ const abi_serializer* const eosio::extension_abi_serializer = &abi_serializer_fo
 const abi_serializer* const eosio::optional_abi_serializer = &abi_serializer_for< ::abieos::pseudo_optional>;
 
 std::vector<char> eosio::abi_type::json_to_bin_reorderable(std::string_view json, std::function<void()> f) const {
-   abieos::jvalue tmp;
-   abieos::json_to_jvalue(tmp, json, f);
    std::vector<char> result;
-   abieos::json_to_bin(result, this, tmp, f);
+   {
+      eosio::container_output writer{ result };
+      if (abieos::json_to_bin_reorderable(writer, this, json, f)) {
+         writer.finish();
+         return result;
+      }
+   }
+   // The json repeats a field which was already written
+   result.clear();
+   abieos::jdocument doc;
+   abieos::json_to_jvalue(doc, json);
+   abieos::json_to_bin(result, this, doc.root, f);
    return result;
 }
 
@@ -290,6 +1094,15 @@ std::vector<char> eosio::abi_type::json_to_bin(std::string_view json, std::funct
    return result;
 }
 
+std::string eosio::json_key(char before, std::string_view name, char after) {
+   std::string result(1, before);
+   eosio::container_output writer{ result };
+   to_json(name, writer);
+   writer.write(after);
+   writer.finish();
+   return result;
+}
+
 std::string eosio::abi_type::bin_to_json(input_stream& bin, std::function<void()> f) const {
    std::string result;
    abieos::bin_to_json(bin, this, result, f);
@@ -2,20 +2,139 @@
 
 #include "eosio/abieos.h"
 #include "abieos.hpp"
+#include "eosio/abieos_ripemd160.hpp"
+#include "thread_pool.hpp"
 
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 
 inline const bool catch_all = true;
 
 using namespace abieos;
 
+// An abi which may be used by several contexts and threads at once. It never changes once it's
+// loaded, except that get_type may add derived types ("x[]", "x?", "x$") the first time they're
+// used; mutex serializes those additions against readers.
+struct shared_abi {
+    mutable abi compiled{};
+    mutable std::shared_mutex mutex{};
+
+    const abi_type* get_type(const std::string& name) const {
+        {
+            std::shared_lock lock{mutex};
+            if (auto* t = compiled.find_type(name))
+                return t;
+        }
+        std::unique_lock lock{mutex};
+        return compiled.get_type(name);
+    }
+};
+
+using contract_map = std::map<name, std::shared_ptr<const shared_abi>>;
+
+struct abi_version {
+    uint32_t valid_from = 0;
+    std::shared_ptr<const shared_abi> abi{};
+
+    // Only kept for the latest version; the next version compares against it to find types it can share
+    std::shared_ptr<const abi_def> def{};
+};
+
+// A contract's abis, ordered by the block they take effect at
+struct abi_history {
+    std::vector<abi_version> versions{};
+
+    static bool before(uint32_t block_num, const abi_version& v) { return block_num < v.valid_from; }
+
+    const abi_version* find(uint32_t block_num) const {
+        auto it = std::upper_bound(versions.begin(), versions.end(), block_num, before);
+        if (it == versions.begin())
+            return nullptr;
+        return &*--it;
+    }
+};
+
+using abi_digest = std::array<unsigned char, abieos_ripemd160::ripemd160_digest_size>;
+
+// Readers take a snapshot of contracts; writers publish a new map. Neither blocks the other.
+struct registry_state {
+    std::mutex write_mutex{};
+    std::shared_ptr<const contract_map> contracts = std::make_shared<contract_map>();
+
+    // Contracts which set identical abis share one. Keyed by a digest of the abi's bytes.
+    std::mutex by_digest_mutex{};
+    std::map<abi_digest, std::weak_ptr<const shared_abi>> by_digest{};
+    size_t next_sweep = 64;
+
+    std::shared_ptr<const shared_abi> find(const abi_digest& digest) {
+        std::lock_guard lock{by_digest_mutex};
+        auto it = by_digest.find(digest);
+        return it == by_digest.end() ? nullptr : it->second.lock();
+    }
+
+    // Returns the abi to use; another thread may have added one for the same digest first
+    std::shared_ptr<const shared_abi> add(const abi_digest& digest, std::shared_ptr<const shared_abi> a) {
+        std::lock_guard lock{by_digest_mutex};
+        auto& entry = by_digest[digest];
+        if (auto existing = entry.lock())
+            return existing;
+        entry = a;
+        if (by_digest.size() >= next_sweep) {
+            for (auto it = by_digest.begin(); it != by_digest.end();) {
+                if (it->second.expired())
+                    it = by_digest.erase(it);
+                else
+                    ++it;
+            }
+            next_sweep = std::max(size_t(64), by_digest.size() * 2);
+        }
+        return a;
+    }
+
+    std::shared_ptr<const contract_map> snapshot() const { return std::atomic_load(&contracts); }
+
+    // Publishes every abi in one new map, so setting many contracts copies the map once
+    void set(std::vector<std::pair<name, std::shared_ptr<const shared_abi>>> abis) {
+        std::lock_guard lock{write_mutex};
+        auto updated = std::make_shared<contract_map>(*snapshot());
+        for (auto& [contract, a] : abis)
+            (*updated)[contract] = std::move(a);
+        std::atomic_store(&contracts, std::shared_ptr<const contract_map>{std::move(updated)});
+    }
+
+    void set(name contract, std::shared_ptr<const shared_abi> a) { set({{contract, std::move(a)}}); }
+};
+
+struct abieos_registry_s {
+    std::shared_ptr<registry_state> state = std::make_shared<registry_state>();
+};
+
 struct abieos_context_s {
     const char* last_error = "";
     std::string last_error_buffer{};
     std::string result_str{};
     std::vector<char> result_bin{};
+    std::vector<char> result_batch{};
+
+    // Runs abieos_bin_to_json_batch when more than one thread is configured
+    std::unique_ptr<thread_pool> pool{};
+    std::vector<std::vector<char>> pool_buffers{};
+
+    std::map<name, abi_history> contracts{};
+    std::shared_ptr<registry_state> registry{};
+
+    // Selects which version of each contract's abi to use
+    uint32_t block_num = UINT32_MAX;
 
-    std::map<name, abi> contracts{};
+    // abis set from now on resolve types on first use
+    bool lazy_abis = false;
+
+    // abis which type handles point into
+    std::set<std::shared_ptr<const shared_abi>> pinned{};
 };
 
 void fix_null_str(const char*& s) {
@@ -80,8 +199,8 @@ extern "C" const char* abieos_get_bin_data(abieos_context* context) {
 
 extern "C" const char* abieos_get_bin_hex(abieos_context* context) {
     return handle_exceptions(context, nullptr, [&] {
-        context->result_str.clear();
-        hex(context->result_bin.begin(), context->result_bin.end(), std::back_inserter(context->result_str));
+        context->result_str.resize(context->result_bin.size() * 2);
+        eosio::hex_encode(context->result_str.data(), context->result_bin.data(), context->result_bin.size());
         return context->result_str.c_str();
     });
 }
@@ -98,66 +217,306 @@ extern "C" const char* abieos_name_to_string(abieos_context* context, uint64_t n
     });
 }
 
+bool parse_abi(abieos_context* context, const char* json, abi_def& def) {
+    context->last_error = "abi parse error";
+    std::string error;
+    std::string abi_copy{json};
+    eosio::json_token_stream stream(abi_copy.data());
+    from_json(def, stream);
+    if (!check_abi_version(def.version, error))
+        return set_error(context, std::move(error));
+    return true;
+}
+
+bool parse_abi(abieos_context* context, const char* data, size_t size, abi_def& def) {
+    context->last_error = "abi parse error";
+    if (!data || !size)
+        return set_error(context, "no data");
+    std::string error;
+    eosio::input_stream stream{data, size};
+    std::string version;
+    from_bin(version, stream);
+    if (!check_abi_version(version, error))
+        return set_error(context, std::move(error));
+    stream = {data, size};
+    from_bin(def, stream);
+    return true;
+}
+
+bool unhex_arg(abieos_context* context, const char* hex, std::vector<char>& data) {
+    auto size = strlen(hex);
+    data.resize(size / 2);
+    if (!eosio::hex_decode(data.data(), hex, size))
+        return set_error(context, "expected hex string");
+    return true;
+}
+
+// Compiles def, sharing unchanged types with prev if it still has its definition
+std::shared_ptr<shared_abi> compile_abi(abieos_context* context, std::shared_ptr<const abi_def> def,
+                                        const abi_version* prev) {
+    auto result = std::make_shared<shared_abi>();
+    if (prev && prev->def) {
+        std::shared_lock lock{prev->abi->mutex};
+        if (context->lazy_abis)
+            convert_lazy(def, result->compiled, *prev->def, {prev->abi, &prev->abi->compiled});
+        else
+            convert(*def, result->compiled, *prev->def, {prev->abi, &prev->abi->compiled});
+    } else {
+        if (context->lazy_abis)
+            convert_lazy(def, result->compiled);
+        else
+            convert(*def, result->compiled);
+    }
+    return result;
+}
+
+template <typename... Args>
+std::shared_ptr<const shared_abi> load_shared_abi(abieos_context* context, registry_state& registry,
+                                                  std::string_view bytes, const Args&... args) {
+    // json and binary abis, and lazy and eager ones, never share
+    const char kind[] = {sizeof...(Args) == 1 ? 'j' : 'b', context->lazy_abis ? 'l' : 'e'};
+    abi_digest digest;
+    abieos_ripemd160::ripemd160_state state;
+    abieos_ripemd160::ripemd160_init(&state);
+    abieos_ripemd160::ripemd160_update(&state, kind, sizeof(kind));
+    abieos_ripemd160::ripemd160_update(&state, bytes.data(), bytes.size());
+    abieos_ripemd160::ripemd160_digest(&state, digest.data());
+    if (auto a = registry.find(digest))
+        return a;
+
+    auto def = std::make_shared<abi_def>();
+    if (!parse_abi(context, args..., *def))
+        return nullptr;
+    return registry.add(digest, compile_abi(context, def, nullptr));
+}
+
+// Adds a version to a contract's history. A version which starts at the same block is replaced
+// if replace is set, otherwise the new one is checked then ignored. compile(prev) creates the abi;
+// def is its definition, if it has one.
+template <typename F>
+bool add_abi_version(abieos_context* context, uint64_t contract, uint32_t valid_from, bool replace,
+                     std::shared_ptr<const abi_def> def, F compile) {
+    auto& versions = context->contracts[name{contract}].versions;
+    auto it = std::lower_bound(versions.begin(), versions.end(), valid_from,
+                               [](const abi_version& v, uint32_t block_num) { return v.valid_from < block_num; });
+    bool exists = it != versions.end() && it->valid_from == valid_from;
+    abi_version* prev = it != versions.begin() ? &it[-1] : nullptr;
+    bool latest = it == versions.end() || (exists && it + 1 == versions.end());
+    abi_version version{valid_from, compile(prev)};
+    if (exists && !replace)
+        return true;
+    if (latest) {
+        version.def = std::move(def);
+        if (prev)
+            prev->def = nullptr;
+    }
+    if (exists)
+        *it = std::move(version);
+    else
+        versions.insert(it, std::move(version));
+    return true;
+}
+
+template <typename... Args>
+bool set_abi_version(abieos_context* context, uint64_t contract, uint32_t valid_from, bool replace,
+                     const Args&... args) {
+    auto def = std::make_shared<abi_def>();
+    if (!parse_abi(context, args..., *def))
+        return false;
+    return add_abi_version(context, contract, valid_from, replace, def,
+                           [&](const abi_version* prev) { return compile_abi(context, def, prev); });
+}
+
 extern "C" abieos_bool abieos_set_abi(abieos_context* context, uint64_t contract, const char* abi) {
     fix_null_str(abi);
+    return handle_exceptions(context, false, [&]() { return set_abi_version(context, contract, 0, false, abi); });
+}
+
+extern "C" abieos_bool abieos_set_abi_bin(abieos_context* context, uint64_t contract, const char* data, size_t size) {
+    return handle_exceptions(context, false,
+                             [&] { return set_abi_version(context, contract, 0, false, data, size); });
+}
+
+extern "C" abieos_bool abieos_set_abi_hex(abieos_context* context, uint64_t contract, const char* hex) {
+    fix_null_str(hex);
+    return handle_exceptions(context, false, [&]() -> abieos_bool {
+        std::vector<char> data;
+        if (!unhex_arg(context, hex, data))
+            return false;
+        return abieos_set_abi_bin(context, contract, data.data(), data.size());
+    });
+}
+
+extern "C" abieos_bool abieos_set_abi_at_block(abieos_context* context, uint64_t contract, uint32_t block_num,
+                                               const char* abi) {
+    fix_null_str(abi);
+    return handle_exceptions(context, false,
+                             [&]() { return set_abi_version(context, contract, block_num, true, abi); });
+}
+
+extern "C" abieos_bool abieos_set_abi_bin_at_block(abieos_context* context, uint64_t contract, uint32_t block_num,
+                                                   const char* data, size_t size) {
+    return handle_exceptions(context, false,
+                             [&] { return set_abi_version(context, contract, block_num, true, data, size); });
+}
+
+extern "C" abieos_bool abieos_set_abi_hex_at_block(abieos_context* context, uint64_t contract, uint32_t block_num,
+                                                   const char* hex) {
+    fix_null_str(hex);
+    return handle_exceptions(context, false, [&]() -> abieos_bool {
+        std::vector<char> data;
+        if (!unhex_arg(context, hex, data))
+            return false;
+        return abieos_set_abi_bin_at_block(context, contract, block_num, data.data(), data.size());
+    });
+}
+
+extern "C" abieos_bool abieos_set_abi_image(abieos_context* context, uint64_t contract, const char* data,
+                                           size_t size) {
+    return handle_exceptions(context, false, [&] {
+        return add_abi_version(context, contract, 0, false, nullptr, [&](const abi_version*) {
+            auto result = std::make_shared<shared_abi>();
+            load_image(result->compiled, {data, size});
+            return result;
+        });
+    });
+}
+
+extern "C" abieos_bool abieos_set_block_num(abieos_context* context, uint32_t block_num) {
+    return handle_exceptions(context, false, [&] {
+        context->block_num = block_num;
+        return true;
+    });
+}
+
+extern "C" abieos_registry* abieos_registry_create() {
+    try {
+        return new abieos_registry{};
+    } catch (...) {
+        if (!catch_all)
+            throw;
+        return nullptr;
+    }
+}
+
+extern "C" void abieos_registry_destroy(abieos_registry* registry) { delete registry; }
+
+extern "C" abieos_bool abieos_registry_set_abi(abieos_context* context, abieos_registry* registry, uint64_t contract,
+                                               const char* abi) {
+    fix_null_str(abi);
     return handle_exceptions(context, false, [&]() {
-        context->last_error = "abi parse error";
-        abi_def def{};
-        std::string error;
-        std::string abi_copy{abi};
-        eosio::json_token_stream stream(abi_copy.data());
-        from_json(def, stream);
-        if (!check_abi_version(def.version, error))
-            return set_error(context, std::move(error));
-        abieos::abi c;
-        convert(def, c);
-        context->contracts.insert({name{contract}, std::move(c)});
+        if (!registry)
+            return set_error(context, "registry is null");
+        auto a = load_shared_abi(context, *registry->state, abi, abi);
+        if (!a)
+            return false;
+        registry->state->set(name{contract}, std::move(a));
         return true;
     });
 }
 
-extern "C" abieos_bool abieos_set_abi_bin(abieos_context* context, uint64_t contract, const char* data, size_t size) {
+extern "C" abieos_bool abieos_registry_set_abi_bin(abieos_context* context, abieos_registry* registry,
+                                                   uint64_t contract, const char* data, size_t size) {
     return handle_exceptions(context, false, [&] {
-        context->last_error = "abi parse error";
-        if (!data || !size)
-            return set_error(context, "no data");
-        std::string error;
-        eosio::input_stream stream{data, size};
-        std::string version;
-        from_bin(version, stream);
-        if (!check_abi_version(version, error))
-            return set_error(context, std::move(error));
-        abi_def def{};
-        stream = {data, size};
-        from_bin(def, stream);
-        abieos::abi c;
-        convert(def, c);
-        context->contracts.insert({name{contract}, std::move(c)});
+        if (!registry)
+            return set_error(context, "registry is null");
+        auto a = load_shared_abi(context, *registry->state, {data, size}, data, size);
+        if (!a)
+            return false;
+        registry->state->set(name{contract}, std::move(a));
         return true;
     });
 }
 
-extern "C" abieos_bool abieos_set_abi_hex(abieos_context* context, uint64_t contract, const char* hex) {
+extern "C" abieos_bool abieos_registry_set_abis_bin(abieos_context* context, abieos_registry* registry,
+                                                    const abieos_abi_item* items, size_t count) {
+    return handle_exceptions(context, false, [&] {
+        if (!registry)
+            return set_error(context, "registry is null");
+        if (count && !items)
+            return set_error(context, "items is null");
+        std::vector<std::pair<name, std::shared_ptr<const shared_abi>>> abis;
+        abis.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            auto& item = items[i];
+            auto a = load_shared_abi(context, *registry->state, {item.data, item.size}, item.data, item.size);
+            if (!a)
+                return false;
+            abis.emplace_back(name{item.contract}, std::move(a));
+        }
+        registry->state->set(std::move(abis));
+        return true;
+    });
+}
+
+extern "C" abieos_bool abieos_registry_set_abi_hex(abieos_context* context, abieos_registry* registry,
+                                                   uint64_t contract, const char* hex) {
     fix_null_str(hex);
     return handle_exceptions(context, false, [&]() -> abieos_bool {
         std::vector<char> data;
-        std::string error;
-        if (!unhex(error, hex, hex + strlen(hex), std::back_inserter(data))) {
-            if (!error.empty())
-                set_error(context, std::move(error));
+        if (!unhex_arg(context, hex, data))
             return false;
+        return abieos_registry_set_abi_bin(context, registry, contract, data.data(), data.size());
+    });
+}
+
+extern "C" abieos_bool abieos_set_registry(abieos_context* context, abieos_registry* registry) {
+    return handle_exceptions(context, false, [&] {
+        if (registry)
+            context->registry = registry->state;
+        else
+            context->registry = nullptr;
+        return true;
+    });
+}
+
+// Finds a contract's abi, first in the context's history at the selected block, then in the
+// attached registry. The result keeps the abi alive even if the registry replaces it.
+std::shared_ptr<const shared_abi> find_abi(abieos_context* context, uint64_t contract) {
+    auto it = context->contracts.find(name{contract});
+    if (it != context->contracts.end())
+        if (auto* version = it->second.find(context->block_num))
+            return version->abi;
+    if (context->registry) {
+        auto contracts = context->registry->snapshot();
+        auto it = contracts->find(name{contract});
+        if (it != contracts->end())
+            return it->second;
+    }
+    throw std::runtime_error("contract \"" + eosio::name_to_string(contract) + "\" is not loaded");
+}
+
+// Like find_abi, but keeps the abi alive until the context is destroyed
+const shared_abi& find_pinned_abi(abieos_context* context, uint64_t contract) {
+    return **context->pinned.insert(find_abi(context, contract)).first;
+}
+
+extern "C" abieos_bool abieos_save_abi_image(abieos_context* context, uint64_t contract) {
+    return handle_exceptions(context, false, [&] {
+        auto a = find_abi(context, contract);
+        std::unique_lock lock{a->mutex};
+        // An image only holds resolved types
+        if (a->compiled.lazy_def) {
+            std::vector<std::string> names;
+            for (auto& [name, _] : a->compiled.abi_types)
+                names.emplace_back(name);
+            for (auto& name : names) {
+                try {
+                    a->compiled.get_type(name);
+                } catch (std::exception&) {
+                }
+            }
         }
-        return abieos_set_abi_bin(context, contract, data.data(), data.size());
+        save_image(a->compiled, context->result_bin);
+        return true;
     });
 }
 
 extern "C" const char* abieos_get_type_for_action(abieos_context* context, uint64_t contract, uint64_t action) {
     return handle_exceptions(context, nullptr, [&] {
-        auto contract_it = context->contracts.find(::abieos::name{contract});
-        if (contract_it == context->contracts.end())
-            throw std::runtime_error("contract \"" + eosio::name_to_string(contract) + "\" is not loaded");
-        auto& c = contract_it->second;
-
+        // The result belongs to the abi, which the context's history or registry keeps alive
+        auto a = find_abi(context, contract);
+        auto& c = a->compiled;
         auto action_it = c.action_types.find(name{action});
         if (action_it == c.action_types.end())
             throw std::runtime_error("contract \"" + eosio::name_to_string(contract) + "\" does not have action \"" +
@@ -168,11 +527,9 @@ extern "C" const char* abieos_get_type_for_action(abieos_context* context, uint6
 
 extern "C" const char* abieos_get_type_for_table(abieos_context* context, uint64_t contract, uint64_t table) {
     return handle_exceptions(context, nullptr, [&] {
-        auto contract_it = context->contracts.find(::abieos::name{contract});
-        if (contract_it == context->contracts.end())
-            throw std::runtime_error("contract \"" + eosio::name_to_string(contract) + "\" is not loaded");
-        auto& c = contract_it->second;
-
+        // The result belongs to the abi, which the context's history or registry keeps alive
+        auto a = find_abi(context, contract);
+        auto& c = a->compiled;
         auto table_it = c.table_types.find(name{table});
         if (table_it == c.table_types.end())
             throw std::runtime_error("contract \"" + eosio::name_to_string(contract) + "\" does not have table \"" +
@@ -181,73 +538,308 @@ extern "C" const char* abieos_get_type_for_table(abieos_context* context, uint64
     });
 }
 
-extern "C" abieos_bool abieos_json_to_bin(abieos_context* context, uint64_t contract, const char* type,
-                                          const char* json) {
+// abieos_type is an opaque name for abi_type
+const abieos_type* to_handle(const abi_type* type) { return reinterpret_cast<const abieos_type*>(type); }
+const abi_type* from_handle(const abieos_type* type) { return reinterpret_cast<const abi_type*>(type); }
+
+// Rejects data which is too large to be a single value of type without decoding it
+void check_bin_size(const abi_type* type, size_t size) {
+    if (size > type->max_bin_size)
+        throw std::runtime_error("Extra data");
+}
+
+extern "C" const abieos_type* abieos_get_type_handle(abieos_context* context, uint64_t contract, const char* type) {
     fix_null_str(type);
+    return handle_exceptions(context, nullptr,
+                             [&] { return to_handle(find_pinned_abi(context, contract).get_type(type)); });
+}
+
+extern "C" abieos_bool abieos_json_to_bin_with_handle(abieos_context* context, const abieos_type* type,
+                                                      const char* json) {
     fix_null_str(json);
     return handle_exceptions(context, false, [&] {
+        if (!type)
+            return set_error(context, "type is null");
         context->last_error = "json parse error";
-        auto contract_it = context->contracts.find(::abieos::name{contract});
-        if (contract_it == context->contracts.end())
-            return set_error(context, "contract \"" + eosio::name_to_string(contract) + "\" is not loaded");
-        std::string error;
-        auto t = contract_it->second.get_type(type);
         context->result_bin.clear();
-        context->result_bin = t->json_to_bin(json);
+        abieos::json_to_bin(context->result_bin, from_handle(type), json, [] {});
         return true;
     });
 }
 
-extern "C" abieos_bool abieos_json_to_bin_reorderable(abieos_context* context, uint64_t contract, const char* type,
-                                                      const char* json) {
-    fix_null_str(type);
+extern "C" abieos_bool abieos_json_to_bin_reorderable_with_handle(abieos_context* context, const abieos_type* type,
+                                                                  const char* json) {
     fix_null_str(json);
     return handle_exceptions(context, false, [&] {
+        if (!type)
+            return set_error(context, "type is null");
         context->last_error = "json parse error";
-        auto contract_it = context->contracts.find(::abieos::name{contract});
-        if (contract_it == context->contracts.end())
-            return set_error(context, "contract \"" + eosio::name_to_string(contract) + "\" is not loaded");
-        std::string error;
-        auto t = contract_it->second.get_type(type);
         context->result_bin.clear();
-        context->result_bin = t->json_to_bin_reorderable(json);
+        context->result_bin = from_handle(type)->json_to_bin_reorderable(json);
         return true;
     });
 }
 
-extern "C" const char* abieos_bin_to_json(abieos_context* context, uint64_t contract, const char* type,
-                                          const char* data, size_t size) {
-    fix_null_str(type);
+extern "C" const char* abieos_bin_to_json_with_handle(abieos_context* context, const abieos_type* type,
+                                                      const char* data, size_t size) {
     return handle_exceptions(context, nullptr, [&]() -> const char* {
+        if (!type) {
+            set_error(context, "type is null");
+            return nullptr;
+        }
         if (!data)
             size = 0;
         context->last_error = "binary decode error";
-        auto contract_it = context->contracts.find(::abieos::name{contract});
-        std::string error;
-        if (contract_it == context->contracts.end()) {
-            (void)set_error(error, "contract \"" + eosio::name_to_string(contract) + "\" is not loaded");
-            return nullptr;
-        }
-        auto t = contract_it->second.get_type(type);
+        check_bin_size(from_handle(type), size);
         eosio::input_stream bin{data, size};
-        context->result_str = t->bin_to_json(bin);
+        abieos::bin_to_json(bin, from_handle(type), context->result_str, [] {});
         if (bin.pos != bin.end)
             throw std::runtime_error("Extra data");
         return context->result_str.c_str();
     });
 }
 
+extern "C" abieos_bool abieos_json_to_bin_buffer(abieos_context* context, const abieos_type* type, const char* json,
+                                                 char* buf, size_t buf_size, size_t* result_size) {
+    fix_null_str(json);
+    return handle_exceptions(context, false, [&] {
+        if (!type || !result_size || (!buf && buf_size))
+            return set_error(context, "type, buf, or result_size is null");
+        context->last_error = "json parse error";
+        eosio::buffer_output writer{buf, buf_size};
+        abieos::json_to_bin(writer, from_handle(type), json, [] {});
+        *result_size = writer.size();
+        return true;
+    });
+}
+
+extern "C" abieos_bool abieos_json_to_bin_in_situ(abieos_context* context, const abieos_type* type, char* json,
+                                                  size_t size) {
+    return handle_exceptions(context, false, [&] {
+        if (!type || !json)
+            return set_error(context, "type or json is null");
+        if (json[size])
+            return set_error(context, "json is not NUL-terminated at size");
+        context->last_error = "json parse error";
+        context->result_bin.clear();
+        eosio::container_output writer{context->result_bin};
+        abieos::json_to_bin_in_situ(writer, from_handle(type), json, size, [] {});
+        writer.finish();
+        return true;
+    });
+}
+
+extern "C" abieos_bool abieos_bin_to_json_buffer(abieos_context* context, const abieos_type* type, const char* data,
+                                                 size_t size, char* buf, size_t buf_size, size_t* result_size) {
+    return handle_exceptions(context, false, [&] {
+        if (!type || !result_size || (!buf && buf_size))
+            return set_error(context, "type, buf, or result_size is null");
+        if (!data)
+            size = 0;
+        context->last_error = "binary decode error";
+        check_bin_size(from_handle(type), size);
+        eosio::input_stream bin{data, size};
+        eosio::buffer_output writer{buf, buf_size};
+        abieos::bin_to_json(bin, from_handle(type), writer, [] {});
+        if (bin.pos != bin.end)
+            throw std::runtime_error("Extra data");
+        writer.write('\0');
+        *result_size = writer.size();
+        return true;
+    });
+}
+
+extern "C" abieos_bool abieos_json_to_bin(abieos_context* context, uint64_t contract, const char* type,
+                                          const char* json) {
+    fix_null_str(type);
+    return handle_exceptions(context, false, [&] {
+        auto c = find_abi(context, contract);
+        return abieos_json_to_bin_with_handle(context, to_handle(c->get_type(type)), json);
+    });
+}
+
+extern "C" abieos_bool abieos_json_to_bin_reorderable(abieos_context* context, uint64_t contract, const char* type,
+                                                      const char* json) {
+    fix_null_str(type);
+    return handle_exceptions(context, false, [&] {
+        auto c = find_abi(context, contract);
+        return abieos_json_to_bin_reorderable_with_handle(context, to_handle(c->get_type(type)), json);
+    });
+}
+
+extern "C" const char* abieos_bin_to_json(abieos_context* context, uint64_t contract, const char* type,
+                                          const char* data, size_t size) {
+    fix_null_str(type);
+    return handle_exceptions(context, nullptr, [&] {
+        auto c = find_abi(context, contract);
+        return abieos_bin_to_json_with_handle(context, to_handle(c->get_type(type)), data, size);
+    });
+}
+
+// Finds the type of an action or table. Types convert couldn't resolve are looked up again to report the error.
+const abi_type* get_named_type(const shared_abi& a, const std::unordered_map<uint64_t, const abi_type*>& resolved,
+                               const std::map<name, std::string>& types, const char* kind, uint64_t contract,
+                               uint64_t n) {
+    auto it = resolved.find(n);
+    if (it != resolved.end())
+        return it->second;
+    auto type_it = types.find(name{n});
+    if (type_it == types.end())
+        throw std::runtime_error("contract \"" + eosio::name_to_string(contract) + "\" does not have " + kind + " \"" +
+                                 eosio::name_to_string(n) + "\"");
+    return a.get_type(type_it->second);
+}
+
+extern "C" const char* abieos_action_bin_to_json(abieos_context* context, uint64_t contract, uint64_t action,
+                                                 const char* data, size_t size) {
+    return handle_exceptions(context, nullptr, [&] {
+        auto c = find_abi(context, contract);
+        auto t = get_named_type(*c, c->compiled.resolved_action_types, c->compiled.action_types, "action", contract,
+                                action);
+        return abieos_bin_to_json_with_handle(context, to_handle(t), data, size);
+    });
+}
+
+extern "C" const char* abieos_table_bin_to_json(abieos_context* context, uint64_t contract, uint64_t table,
+                                                const char* data, size_t size) {
+    return handle_exceptions(context, nullptr, [&] {
+        auto c = find_abi(context, contract);
+        auto t =
+            get_named_type(*c, c->compiled.resolved_table_types, c->compiled.table_types, "table", contract, table);
+        return abieos_bin_to_json_with_handle(context, to_handle(t), data, size);
+    });
+}
+
+extern "C" abieos_bool abieos_set_lazy_abis(abieos_context* context, abieos_bool lazy) {
+    return handle_exceptions(context, false, [&] {
+        context->lazy_abis = lazy;
+        return true;
+    });
+}
+
+extern "C" abieos_bool abieos_set_threads(abieos_context* context, uint32_t num_threads) {
+    return handle_exceptions(context, false, [&] {
+        context->pool = nullptr;
+        if (num_threads > 1)
+            context->pool = std::make_unique<thread_pool>(num_threads);
+        context->pool_buffers.resize(num_threads > 1 ? num_threads : 0);
+        return true;
+    });
+}
+
+// Converts one batch item. On failure, writes the error message instead of the json. Doesn't
+// modify context, so several threads may run it at once.
+struct batch_converter {
+    abieos_context* context;
+    std::shared_ptr<const shared_abi> c{};
+    uint64_t c_contract = 0;
+
+    bool operator()(const abieos_bin_item& item, eosio::output_stream& writer) {
+        auto start = writer.size();
+        try {
+            auto* t = from_handle(item.handle);
+            if (!t) {
+                if (!c || c_contract != item.contract) {
+                    c = nullptr;
+                    c = find_abi(context, item.contract);
+                    c_contract = item.contract;
+                }
+                t = c->get_type(item.type ? item.type : "");
+            }
+            eosio::input_stream bin{item.data, item.data ? item.size : 0};
+            check_bin_size(t, bin.remaining());
+            writer.reserve(t->estimate_json_size(bin.remaining()) + 1);
+            abieos::bin_to_json(bin, t, writer, [] {});
+            if (bin.pos != bin.end)
+                throw std::runtime_error("Extra data");
+            writer.write('\0');
+            return true;
+        } catch (std::exception& e) {
+            writer.pos = writer.begin + start;
+            writer.write(e.what(), strlen(e.what()) + 1);
+        } catch (...) {
+            writer.pos = writer.begin + start;
+            writer.write("unknown exception", sizeof("unknown exception"));
+        }
+        return false;
+    }
+};
+
+// Splits the items between the pool's threads. Each thread starts on its own range, then steals
+// from the other ranges once that's done. Each thread writes to its own buffer; the results are
+// then gathered in order.
+void parallel_bin_to_json_batch(abieos_context* context, const abieos_bin_item* items, size_t count, size_t* offsets,
+                                abieos_bool* ok) {
+    struct range {
+        std::atomic<size_t> next;
+        size_t end;
+    };
+    auto num_threads = context->pool->size();
+    std::vector<range> ranges(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        ranges[i].next = count * i / num_threads;
+        ranges[i].end = count * (i + 1) / num_threads;
+    }
+    std::vector<uint32_t> item_thread(count);
+    context->pool->run([&](size_t index) {
+        auto& buffer = context->pool_buffers[index];
+        buffer.clear();
+        eosio::container_output writer{buffer};
+        batch_converter convert{context};
+        for (size_t r = 0; r < num_threads; ++r) {
+            auto& rng = ranges[(index + r) % num_threads];
+            for (size_t i; (i = rng.next.fetch_add(1, std::memory_order_relaxed)) < rng.end;) {
+                offsets[i] = writer.size();
+                item_thread[i] = index;
+                ok[i] = convert(items[i], writer);
+            }
+        }
+        writer.finish();
+    });
+
+    auto& result = context->result_batch;
+    result.clear();
+    size_t total = 0;
+    for (auto& buffer : context->pool_buffers)
+        total += buffer.size();
+    result.reserve(total);
+    for (size_t i = 0; i < count; ++i) {
+        auto* json = context->pool_buffers[item_thread[i]].data() + offsets[i];
+        offsets[i] = result.size();
+        result.insert(result.end(), json, json + strlen(json) + 1);
+    }
+}
+
+extern "C" const char* abieos_bin_to_json_batch(abieos_context* context, const abieos_bin_item* items, size_t count,
+                                                size_t* offsets, abieos_bool* ok) {
+    return handle_exceptions(context, nullptr, [&]() -> const char* {
+        if (count && (!items || !offsets || !ok)) {
+            set_error(context, "items, offsets, or ok is null");
+            return nullptr;
+        }
+        if (context->pool && count > 1) {
+            parallel_bin_to_json_batch(context, items, count, offsets, ok);
+            return context->result_batch.data();
+        }
+        context->result_batch.clear();
+        eosio::container_output writer{context->result_batch};
+        batch_converter convert{context};
+        for (size_t i = 0; i < count; ++i) {
+            offsets[i] = writer.size();
+            ok[i] = convert(items[i], writer);
+        }
+        writer.finish();
+        return context->result_batch.data();
+    });
+}
+
 extern "C" const char* abieos_hex_to_json(abieos_context* context, uint64_t contract, const char* type,
                                           const char* hex) {
     fix_null_str(hex);
     return handle_exceptions(context, nullptr, [&]() -> const char* {
         std::vector<char> data;
-        std::string error;
-        if (!unhex(error, hex, hex + strlen(hex), std::back_inserter(data))) {
-            if (!error.empty())
-                set_error(context, std::move(error));
+        if (!unhex_arg(context, hex, data))
             return nullptr;
-        }
         return abieos_bin_to_json(context, contract, type, data.data(), data.size());
     });
 }
@@ -26,8 +26,10 @@
 #pragma clang diagnostic ignored "-W#warnings"
 #endif
 
+#include <algorithm>
 #include <ctime>
 #include <map>
+#include <memory>
 #include <optional>
 #include <variant>
 #include <vector>
@@ -111,83 +113,86 @@ ABIEOS_NODISCARD bool unhex(std::string& error, SrcIt begin, SrcIt end, DestIt d
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// stream events
+// json model
 ///////////////////////////////////////////////////////////////////////////////
 
-enum class event_type {
-    received_null,         // 0
-    received_bool,         // 1
-    received_string,       // 2
-    received_start_object, // 3
-    received_key,          // 4
-    received_end_object,   // 5
-    received_start_array,  // 6
-    received_end_array,    // 7
-};
+// Bump allocator for a jdocument. Nodes are trivially destructible, so the whole tree goes away
+// with the arena's blocks.
+class jarena {
+  public:
+    template <typename T>
+    T* allocate(size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        size_t size = n * sizeof(T);
+        if (!size)
+            return nullptr;
+        used = (used + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (size > block_size - used || blocks.empty()) {
+            if (size > block_size / 4) {
+                large.push_back(std::make_unique<char[]>(size));
+                return reinterpret_cast<T*>(large.back().get());
+            }
+            blocks.push_back(std::make_unique<char[]>(block_size));
+            used = 0;
+        }
+        auto* result = reinterpret_cast<T*>(blocks.back().get() + used);
+        used += size;
+        return result;
+    }
 
-struct event_data {
-    bool value_bool = 0;
-    std::string value_string{};
-    std::string key{};
+  private:
+    static constexpr size_t block_size = 16 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> large;
+    size_t used = 0;
 };
 
-template <typename Derived>
-struct json_reader_handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, Derived> {
-    event_data received_data{};
-    bool started = false;
+enum class jvalue_kind : uint8_t {
+    null,
+    boolean,
+    string,
+    object,
+    array,
+};
 
-    Derived& get_derived() { return *static_cast<Derived*>(this); }
+struct jmember;
 
-    bool get_start() {
-        if (started)
-            return false;
-        started = true;
-        return true;
-    }
-
-    bool get_bool() const { return received_data.value_bool; }
+// Strings point into the document's json; objects and arrays point into its arena
+struct jvalue {
+    jvalue_kind kind = jvalue_kind::null;
+    bool value_bool = false;
+    uint32_t size = 0;
+    union {
+        const char* chars = nullptr;
+        const jmember* members; // sorted by key
+        const jvalue* elements;
+    };
 
-    const std::string& get_string() const { return received_data.value_string; }
+    std::string_view string() const { return {chars, size}; }
 
-    bool Null() { return receive_event(get_derived(), event_type::received_null, get_start()); }
-    bool Bool(bool v) {
-        received_data.value_bool = v;
-        return receive_event(get_derived(), event_type::received_bool, get_start());
-    }
-    bool RawNumber(const char* v, rapidjson::SizeType length, bool copy) { return String(v, length, copy); }
-    bool Int(int v) { return false; }
-    bool Uint(unsigned v) { return false; }
-    bool Int64(int64_t v) { return false; }
-    bool Uint64(uint64_t v) { return false; }
-    bool Double(double v) { return false; }
-    bool String(const char* v, rapidjson::SizeType length, bool) {
-        received_data.value_string = {v, length};
-        return receive_event(get_derived(), event_type::received_string, get_start());
-    }
-    bool StartObject() { return receive_event(get_derived(), event_type::received_start_object, get_start()); }
-    bool Key(const char* v, rapidjson::SizeType length, bool) {
-        received_data.key = {v, length};
-        return receive_event(get_derived(), event_type::received_key, get_start());
-    }
-    bool EndObject(rapidjson::SizeType) {
-        return receive_event(get_derived(), event_type::received_end_object, get_start());
-    }
-    bool StartArray() { return receive_event(get_derived(), event_type::received_start_array, get_start()); }
-    bool EndArray(rapidjson::SizeType) {
-        return receive_event(get_derived(), event_type::received_end_array, get_start());
-    }
+    // Returns nullptr if there's no member named key
+    const jvalue* find(std::string_view key) const;
 };
 
-///////////////////////////////////////////////////////////////////////////////
-// json model
-///////////////////////////////////////////////////////////////////////////////
+struct jmember {
+    std::string_view key;
+    jvalue value;
+};
 
-struct jvalue;
-using jarray = std::vector<jvalue>;
-using jobject = std::map<std::string, jvalue>;
+inline const jvalue* jvalue::find(std::string_view key) const {
+    auto end = members + size;
+    auto it = std::lower_bound(members, end, key, [](const jmember& m, std::string_view k) { return m.key < k; });
+    if (it == end || it->key != key)
+        return nullptr;
+    return &it->value;
+}
 
-struct jvalue {
-    std::variant<std::nullptr_t, bool, std::string, jobject, jarray> value;
+// A parsed json document. Owns the json which its strings point into.
+struct jdocument {
+    std::string json;
+    jarena arena;
+    jvalue root;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -196,16 +201,6 @@ struct jvalue {
 
 using eosio::abi_type;
 
-struct size_insertion {
-    size_t position = 0;
-    uint32_t size = 0;
-};
-
-struct json_to_jvalue_stack_entry {
-    jvalue* value = nullptr;
-    std::string key = "";
-};
-
 struct jvalue_to_bin_stack_entry {
     const abi_type* type = nullptr;
     bool allow_extensions = false;
@@ -217,8 +212,21 @@ struct json_to_bin_stack_entry {
     const abi_type* type = nullptr;
     bool allow_extensions = false;
     int position = -1;
-    size_t size_insertion_index = 0;
+    size_t size_position = 0;
     size_t variant_type_index = 0;
+
+    // Reorderable objects: the field whose value is being read, and where its binary starts
+    int value_field = -1;
+    size_t value_start = 0;
+    bool outer_skipped_extension = false;
+};
+
+// A field which arrived before its turn, already converted to binary
+struct early_field {
+    size_t depth = 0;
+    int field = 0;
+    bool skipped_extension = false;
+    std::vector<char> bin;
 };
 
 struct bin_to_json_stack_entry {
@@ -228,13 +236,6 @@ struct bin_to_json_stack_entry {
     uint32_t array_size = 0;
 };
 
-struct json_to_jvalue_state : json_reader_handler<json_to_jvalue_state> {
-    std::string& error;
-    std::vector<json_to_jvalue_stack_entry> stack;
-
-    json_to_jvalue_state(std::string& error) : error{error} {}
-};
-
 struct jvalue_to_bin_state {
     eosio::vector_stream writer;
     const jvalue* received_value = nullptr;
@@ -242,43 +243,47 @@ struct jvalue_to_bin_state {
     bool skipped_extension = false;
 
     bool get_bool() const {
-      auto* b = std::get_if<bool>(&received_value->value);
-      eosio::check(b, eosio::convert_json_error(eosio::from_json_error::expected_bool));
-      return *b;
+        eosio::check(received_value->kind == jvalue_kind::boolean,
+                     eosio::convert_json_error(eosio::from_json_error::expected_bool));
+        return received_value->value_bool;
     }
 
     std::string_view get_string() const {
-        auto* s = std::get_if<std::string>(&received_value->value);
-        eosio::check(s, eosio::convert_json_error(eosio::from_json_error::expected_string));
-        return *s;
+        eosio::check(received_value->kind == jvalue_kind::string,
+                     eosio::convert_json_error(eosio::from_json_error::expected_string));
+        return received_value->string();
     }
     void get_null() {
-       eosio::check(std::holds_alternative<std::nullptr_t>(received_value->value),
-              eosio::convert_json_error(eosio::from_json_error::expected_null));
+        eosio::check(received_value->kind == jvalue_kind::null,
+                     eosio::convert_json_error(eosio::from_json_error::expected_null));
     }
     bool get_null_pred() {
-       return std::holds_alternative<std::nullptr_t>(received_value->value);
+       return received_value->kind == jvalue_kind::null;
     }
 };
 
 struct json_to_bin_state : eosio::json_token_stream {
-    using json_token_stream::json_token_stream;
-    eosio::vector_stream& writer;
-    std::vector<size_insertion> size_insertions{};
+    eosio::output_stream& writer;
     std::vector<json_to_bin_stack_entry> stack{};
     bool skipped_extension = false;
 
-    explicit json_to_bin_state(char* in, eosio::vector_stream& out)
-      : eosio::json_token_stream(in), writer(out) {}
+    // Accept fields in any order. Fields which arrive in order are still written as they're read.
+    bool reorderable = false;
+    std::vector<early_field> early_fields{};
+    // Set if the json can't be streamed, e.g. it repeats a field which was already written
+    bool needs_dom = false;
+
+    explicit json_to_bin_state(char* in, size_t size, eosio::output_stream& out)
+      : eosio::json_token_stream(in, size), writer(out) {}
 };
 
 struct bin_to_json_state {
     eosio::input_stream& bin;
-    eosio::vector_stream& writer;
+    eosio::output_stream& writer;
     std::vector<bin_to_json_stack_entry> stack{};
     bool skipped_extension = false;
 
-    bin_to_json_state(eosio::input_stream& bin, eosio::vector_stream& writer)
+    bin_to_json_state(eosio::input_stream& bin, eosio::output_stream& writer)
         : bin{bin}, writer{writer} {}
 };
 
@@ -347,6 +352,22 @@ void bin_to_json(pseudo_variant*, bin_to_json_state& state, bool allow_extension
 
 using eosio::bytes;
 
+inline bool unhex_to(eosio::vector_stream& writer, std::string_view hex) {
+    auto size = writer.data.size();
+    writer.data.resize(size + hex.size() / 2);
+    return eosio::hex_decode(writer.data.data() + size, hex.data(), hex.size());
+}
+
+inline bool unhex_to(eosio::output_stream& writer, std::string_view hex) {
+    auto size = hex.size() / 2;
+    if (size_t(writer.end - writer.pos) < size)
+        writer.grow(writer, size);
+    if (!eosio::hex_decode(writer.pos, hex.data(), hex.size()))
+        return false;
+    writer.pos += size;
+    return true;
+}
+
 template <typename State>
 void json_to_bin(bytes*, State& state, bool, const abi_type*, bool start) {
     auto s = state.get_string();;
@@ -354,8 +375,7 @@ void json_to_bin(bytes*, State& state, bool, const abi_type*, bool start) {
         printf("%*sbytes (%d hex digits)\n", int(state.stack.size() * 4), "", int(s.size()));
     eosio::check( !(s.size() & 1), eosio::convert_json_error(eosio::from_json_error::expected_hex_string) );
     eosio::varuint32_to_bin(s.size() / 2, state.writer);
-    // FIXME: Add a function to encode a hex string to a stream
-    eosio::check(eosio::unhex(std::back_inserter(state.writer.data), s.begin(), s.end()),
+    eosio::check(unhex_to(state.writer, s),
         eosio::convert_json_error(eosio::from_json_error::expected_hex_string));
 }
 
@@ -466,108 +486,88 @@ ABIEOS_NODISCARD inline bool check_abi_version(const std::string& s, std::string
 // json_to_jvalue
 ///////////////////////////////////////////////////////////////////////////////
 
-ABIEOS_NODISCARD bool json_to_jobject(jvalue& value, json_to_jvalue_state& state, event_type event, bool start);
-ABIEOS_NODISCARD bool json_to_jarray(jvalue& value, json_to_jvalue_state& state, event_type event, bool start);
-
-ABIEOS_NODISCARD inline bool receive_event(struct json_to_jvalue_state& state, event_type event, bool start) {
-    if (state.stack.empty())
-        return set_error(state, "extra data");
-    if (state.stack.size() > max_stack_size)
-        return set_error(state, "recursion limit reached");
-    if (trace_json_to_jvalue_event)
-        printf("(event %d)\n", (int)event);
-    auto& v = *state.stack.back().value;
-    if (start) {
-        state.stack.pop_back();
-        if (event == event_type::received_null) {
-            v.value = nullptr;
-        } else if (event == event_type::received_bool) {
-            v.value = state.get_bool();
-        } else if (event == event_type::received_string) {
-            v.value = std::move(state.get_string());
-        } else if (event == event_type::received_start_object) {
-            v.value = jobject{};
-            return json_to_jobject(v, state, event, start);
-        } else if (event == event_type::received_start_array) {
-            v.value = jarray{};
-            return json_to_jarray(v, state, event, start);
+// Parses json into doc. Each container's members collect on a shared scratch stack, then move
+// into the arena in one piece once the container ends.
+inline void json_to_jvalue(jdocument& doc, std::string_view json) {
+    struct frame {
+        size_t first;
+        bool object;
+        std::string_view key;
+    };
+    doc.json.assign(json);
+    eosio::json_token_stream stream(doc.json.data());
+    std::vector<frame> stack;
+    std::vector<jmember> scratch;
+    while (true) {
+        std::string_view key;
+        jvalue value;
+        bool ended = false;
+        if (!stack.empty() && stack.back().object) {
+            ended = stream.get_end_object_pred();
+            if (!ended)
+                key = stream.get_key();
+        } else if (!stack.empty()) {
+            ended = stream.get_end_array_pred();
+        }
+        if (ended) {
+            auto f = stack.back();
+            stack.pop_back();
+            auto begin = scratch.begin() + f.first;
+            auto n = scratch.end() - begin;
+            value.size = n;
+            if (f.object) {
+                // Duplicate keys: the last one wins
+                std::stable_sort(begin, scratch.end(), [](auto& a, auto& b) { return a.key < b.key; });
+                auto out = begin;
+                for (auto it = begin; it != scratch.end(); ++it) {
+                    if (it + 1 != scratch.end() && it[1].key == it->key)
+                        continue;
+                    *out++ = *it;
+                }
+                value.size = out - begin;
+                auto* members = doc.arena.allocate<jmember>(value.size);
+                std::copy(begin, out, members);
+                value.kind = jvalue_kind::object;
+                value.members = members;
+            } else {
+                auto* elements = doc.arena.allocate<jvalue>(n);
+                for (auto it = begin; it != scratch.end(); ++it)
+                    elements[it - begin] = it->value;
+                value.kind = jvalue_kind::array;
+                value.elements = elements;
+            }
+            scratch.erase(begin, scratch.end());
+            key = f.key;
         } else {
-            return false;
+            auto& t = stream.peek_token().get();
+            switch (t.type) {
+            case eosio::json_token_type::type_null: break;
+            case eosio::json_token_type::type_bool:
+                value.kind = jvalue_kind::boolean;
+                value.value_bool = t.value_bool;
+                break;
+            case eosio::json_token_type::type_string:
+                value.kind = jvalue_kind::string;
+                value.chars = t.value_string.data();
+                value.size = t.value_string.size();
+                break;
+            case eosio::json_token_type::type_start_object:
+            case eosio::json_token_type::type_start_array:
+                eosio::check(stack.size() < max_stack_size, "recursion limit reached");
+                stack.push_back({scratch.size(), t.type == eosio::json_token_type::type_start_object, key});
+                stream.eat_token();
+                continue;
+            default: eosio::check(false, eosio::convert_json_error(eosio::from_json_error::unspecific_syntax_error));
+            }
+            stream.eat_token();
         }
-    } else {
-        if (std::holds_alternative<jobject>(v.value))
-            return json_to_jobject(v, state, event, start);
-        else if (std::holds_alternative<jarray>(v.value))
-            return json_to_jarray(v, state, event, start);
-        else
-            return set_error(state, "extra data");
-    }
-    return true;
-}
-
-template<typename F>
-inline void json_to_jvalue(jvalue& value, std::string_view json, F&& f) {
-    std::string mutable_json{json};
-    mutable_json.push_back(0);
-    mutable_json.push_back(0);
-    mutable_json.push_back(0);
-    std::string error; // !!!
-    json_to_jvalue_state state{error};
-    state.stack.push_back({&value});
-    rapidjson::Reader reader;
-    rapidjson::InsituStringStream ss(mutable_json.data());
-    eosio::check(reader.Parse<rapidjson::kParseValidateEncodingFlag | rapidjson::kParseIterativeFlag |
-        rapidjson::kParseNumbersAsStringsFlag>(ss, state),
-        eosio::convert_json_error(eosio::from_json_error::unspecific_syntax_error));
-}
-
-ABIEOS_NODISCARD inline bool json_to_jobject(jvalue& value, json_to_jvalue_state& state, event_type event, bool start) {
-    if (start) {
-        if (event != event_type::received_start_object)
-            return set_error(state, "expected object");
-        if (trace_json_to_jvalue)
-            printf("%*s{\n", int(state.stack.size() * 4), "");
-        state.stack.push_back({&value});
-        return true;
-    } else if (event == event_type::received_end_object) {
-        if (trace_json_to_jvalue)
-            printf("%*s}\n", int((state.stack.size() - 1) * 4), "");
-        state.stack.pop_back();
-        return true;
-    }
-    auto& stack_entry = state.stack.back();
-    if (event == event_type::received_key) {
-        stack_entry.key = std::move(state.received_data.key);
-        return true;
-    } else {
-        if (trace_json_to_jvalue)
-            printf("%*sfield %s (event %d)\n", int(state.stack.size() * 4), "", stack_entry.key.c_str(), (int)event);
-        auto& x = std::get<jobject>(value.value)[stack_entry.key] = {};
-        state.stack.push_back({&x});
-        return receive_event(state, event, true);
-    }
-}
-
-ABIEOS_NODISCARD inline bool json_to_jarray(jvalue& value, json_to_jvalue_state& state, event_type event, bool start) {
-    if (start) {
-        if (event != event_type::received_start_array)
-            return set_error(state, "expected array");
-        if (trace_json_to_jvalue)
-            printf("%*s[\n", int(state.stack.size() * 4), "");
-        state.stack.push_back({&value});
-        return true;
-    } else if (event == event_type::received_end_array) {
-        if (trace_json_to_jvalue)
-            printf("%*s]\n", int((state.stack.size() - 1) * 4), "");
-        state.stack.pop_back();
-        return true;
+        if (stack.empty()) {
+            doc.root = value;
+            break;
+        }
+        scratch.push_back({key, value});
     }
-    auto& v = std::get<jarray>(value.value);
-    if (trace_json_to_jvalue)
-        printf("%*sitem %d (event %d)\n", int(state.stack.size() * 4), "", int(v.size()), (int)event);
-    v.emplace_back();
-    state.stack.push_back({&v.back()});
-    return receive_event(state, event, true);
+    stream.get_end();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -616,7 +616,7 @@ inline void json_to_bin(pseudo_extension*, State& state, bool allow_extensions,
 inline void json_to_bin(pseudo_object*, jvalue_to_bin_state& state, bool allow_extensions,
                                        const abi_type* type, bool start) {
     if (start) {
-       eosio::check(!(!state.received_value || !std::holds_alternative<jobject>(state.received_value->value)),
+       eosio::check(state.received_value && state.received_value->kind == jvalue_kind::object,
             eosio::convert_json_error(eosio::from_json_error::expected_start_object));
         if (trace_jvalue_to_bin)
             printf("%*s{ %d fields, allow_ex=%d\n", int(state.stack.size() * 4), "", int(type->as_struct()->fields.size()),
@@ -633,12 +633,11 @@ inline void json_to_bin(pseudo_object*, jvalue_to_bin_state& state, bool allow_e
         return;
     }
     auto& field = fields[stack_entry.position];
-    auto& obj = std::get<jobject>(stack_entry.value->value);
-    auto it = obj.find(field.name);
+    auto* value = stack_entry.value->find(field.name);
     if (trace_jvalue_to_bin)
         printf("%*sfield %d/%d: %s\n", int(state.stack.size() * 4), "", int(stack_entry.position),
                int(fields.size()), std::string{field.name}.c_str());
-    if (it == obj.end()) {
+    if (!value) {
         if (field.type->extension_of() && allow_extensions) {
             state.skipped_extension = true;
             return;
@@ -648,7 +647,7 @@ inline void json_to_bin(pseudo_object*, jvalue_to_bin_state& state, bool allow_e
     }
     eosio::check(!state.skipped_extension,
         eosio::convert_json_error(eosio::from_json_error::unexpected_field));
-    state.received_value = &it->second;
+    state.received_value = value;
     return field.type->ser->json_to_bin(state, allow_extensions && &field == &fields.back(),
                                         field.type, true);
 }
@@ -656,24 +655,23 @@ inline void json_to_bin(pseudo_object*, jvalue_to_bin_state& state, bool allow_e
 inline void json_to_bin(pseudo_array*, jvalue_to_bin_state& state, bool, const abi_type* type,
                                        bool start) {
     if (start) {
-       eosio::check(!(!state.received_value || !std::holds_alternative<jarray>(state.received_value->value)),
+       eosio::check(state.received_value && state.received_value->kind == jvalue_kind::array,
             eosio::convert_json_error(eosio::from_json_error::expected_start_array));
         if (trace_jvalue_to_bin)
-            printf("%*s[ %d elements\n", int(state.stack.size() * 4), "",
-                   int(std::get<jarray>(state.received_value->value).size()));
-        eosio::varuint32_to_bin(std::get<jarray>(state.received_value->value).size(), state.writer);
+            printf("%*s[ %d elements\n", int(state.stack.size() * 4), "", int(state.received_value->size));
+        eosio::varuint32_to_bin(state.received_value->size, state.writer);
         state.stack.push_back({type, false, state.received_value, -1});
     }
     auto& stack_entry = state.stack.back();
-    auto& arr = std::get<jarray>(stack_entry.value->value);
+    auto& arr = *stack_entry.value;
     ++stack_entry.position;
-    if (stack_entry.position == (int)arr.size()) {
+    if (stack_entry.position == (int)arr.size) {
         if (trace_jvalue_to_bin)
             printf("%*s]\n", int((state.stack.size() - 1) * 4), "");
         state.stack.pop_back();
         return;
     }
-    state.received_value = &arr[stack_entry.position];
+    state.received_value = &arr.elements[stack_entry.position];
     if (trace_jvalue_to_bin)
         printf("%*sitem\n", int(state.stack.size() * 4), "");
     const abi_type * t = type->array_of();
@@ -683,30 +681,27 @@ inline void json_to_bin(pseudo_array*, jvalue_to_bin_state& state, bool, const a
 inline void json_to_bin(pseudo_variant*, jvalue_to_bin_state& state, bool allow_extensions,
                                        const abi_type* type, bool start) {
     if (start) {
-       eosio::check(!(!state.received_value || !std::holds_alternative<jarray>(state.received_value->value)),
+       eosio::check(state.received_value && state.received_value->kind == jvalue_kind::array,
             eosio::convert_json_error(eosio::from_json_error::expected_variant));
-        auto& arr = std::get<jarray>(state.received_value->value);
-        eosio::check(arr.size() == 2,
+        auto& arr = *state.received_value;
+        eosio::check(arr.size == 2,
             eosio::convert_json_error(eosio::from_json_error::expected_variant));
-        eosio::check(std::holds_alternative<std::string>(arr[0].value),
+        eosio::check(arr.elements[0].kind == jvalue_kind::string,
             eosio::convert_json_error(eosio::from_json_error::expected_variant));
-        auto& typeName = std::get<std::string>(arr[0].value);
         if (trace_jvalue_to_bin)
-            printf("%*s[ variant %s\n", int(state.stack.size() * 4), "", typeName.c_str());
+            printf("%*s[ variant %s\n", int(state.stack.size() * 4), "", std::string{arr.elements[0].string()}.c_str());
         state.stack.push_back({type, allow_extensions, state.received_value, 0});
         return;
     }
     auto& stack_entry = state.stack.back();
-    auto& arr = std::get<jarray>(stack_entry.value->value);
+    auto& arr = *stack_entry.value;
     if (stack_entry.position == 0) {
-        auto& typeName = std::get<std::string>(arr[0].value);
         const std::vector<eosio::abi_field>& fields = *stack_entry.type->as_variant();
-        auto it = std::find_if(fields.begin(), fields.end(),
-                               [&](auto& field) { return field.name == typeName; });
-        eosio::check(it != fields.end(),
+        auto* it = stack_entry.type->find_alternative(arr.elements[0].string());
+        eosio::check(it,
             eosio::convert_json_error(eosio::from_json_error::invalid_type_for_variant));
-        eosio::varuint32_to_bin(it - fields.begin(), state.writer);
-        state.received_value = &arr[++stack_entry.position];
+        eosio::varuint32_to_bin(it - fields.data(), state.writer);
+        state.received_value = &arr.elements[++stack_entry.position];
         return it->type->ser->json_to_bin(state, allow_extensions, it->type, true);
     } else {
         if (trace_jvalue_to_bin)
@@ -736,18 +731,12 @@ inline void json_to_bin(std::string*, State& state, bool, const abi_type*,
 // json_to_bin
 ///////////////////////////////////////////////////////////////////////////////
 
+// Arrays are written with a one-byte placeholder for their size. If the size needs more bytes,
+// the array's contents move to make room, so the output is built in place in a single pass.
 template<typename F>
-inline void json_to_bin(std::vector<char>& bin, const abi_type* type, std::string_view json, F&& f) {
-    std::string mutable_json{json};
-    mutable_json.push_back(0);
-    mutable_json.push_back(0);
-    mutable_json.push_back(0);
-    std::vector<char> out_buf;
-    eosio::vector_stream out(out_buf);
-    json_to_bin_state state(mutable_json.data(), out);
-
+inline void json_to_bin(json_to_bin_state& state, const abi_type* type, F&& f) {
     type->ser->json_to_bin(state, true, type, true);
-    while(!state.stack.empty()) {
+    while(!state.stack.empty() && !state.needs_dom) {
         f();
         auto entry = state.stack.back();
         auto* type = entry.type;
@@ -755,16 +744,139 @@ inline void json_to_bin(std::vector<char>& bin, const abi_type* type, std::strin
             eosio::convert_abi_error(eosio::abi_error::recursion_limit_reached));
         type->ser->json_to_bin(state, entry.allow_extensions, type, false);
     }
-    eosio::check(state.complete(),
-        eosio::convert_json_error(eosio::from_json_error::expected_end));
+    if (!state.needs_dom)
+        eosio::check(state.complete(),
+            eosio::convert_json_error(eosio::from_json_error::expected_end));
+}
+
+// Converts json in place, without copying it. json[size] must be 0. json's contents are unspecified afterwards.
+template<typename F>
+inline void json_to_bin_in_situ(eosio::output_stream& bin, const abi_type* type, char* json, size_t size, F&& f) {
+    json_to_bin_state state(json, size, bin);
+    json_to_bin(state, type, f);
+}
 
-    size_t pos = 0;
-    for (auto& insertion : state.size_insertions) {
-        bin.insert(bin.end(), out_buf.begin() + pos, out_buf.begin() + insertion.position);
-        eosio::push_varuint32(bin, insertion.size);
-        pos = insertion.position;
+template<typename F>
+inline void json_to_bin(eosio::output_stream& bin, const abi_type* type, std::string_view json, F&& f) {
+    std::string mutable_json{json};
+    json_to_bin_in_situ(bin, type, mutable_json.data(), mutable_json.size(), f);
+}
+
+// Converts json whose objects may have their fields in any order. Returns false, with bin in an
+// unspecified state, if the json needs the full tree from json_to_jvalue instead.
+template<typename F>
+ABIEOS_NODISCARD inline bool json_to_bin_reorderable(eosio::output_stream& bin, const abi_type* type,
+                                                     std::string_view json, F&& f) {
+    std::string mutable_json{json};
+    json_to_bin_state state(mutable_json.data(), mutable_json.size(), bin);
+    state.reorderable = true;
+    json_to_bin(state, type, f);
+    return !state.needs_dom;
+}
+
+template<typename F>
+inline void json_to_bin(std::vector<char>& bin, const abi_type* type, std::string_view json, F&& f) {
+    eosio::container_output writer{bin};
+    json_to_bin(writer, type, json, f);
+    writer.finish();
+}
+
+// Consumes the next value
+inline void skip_json_value(json_to_bin_state& state) {
+    int depth = 0;
+    do {
+        auto t = state.peek_token().get().type;
+        state.eat_token();
+        if (t == eosio::json_token_type::type_start_object || t == eosio::json_token_type::type_start_array)
+            ++depth;
+        else if (t == eosio::json_token_type::type_end_object || t == eosio::json_token_type::type_end_array)
+            --depth;
+    } while (depth > 0);
+}
+
+// Writes the object's next field if it arrived early. Returns false if it hasn't arrived.
+inline bool write_early_field(json_to_bin_state& state, json_to_bin_stack_entry& stack_entry) {
+    auto depth = state.stack.size();
+    for (auto it = state.early_fields.rbegin(); it != state.early_fields.rend() && it->depth == depth; ++it) {
+        if (it->field != stack_entry.position + 1)
+            continue;
+        eosio::check(!state.skipped_extension, eosio::convert_json_error(eosio::from_json_error::unexpected_field));
+        state.writer.write(it->bin.data(), it->bin.size());
+        state.skipped_extension |= it->skipped_extension;
+        ++stack_entry.position;
+        state.early_fields.erase(std::next(it).base());
+        return true;
     }
-    bin.insert(bin.end(), out_buf.begin() + pos, out_buf.end());
+    return false;
+}
+
+// Fields which arrive in order are written as they're read. A field which arrives early is written
+// to the end of the output, then moved to early_fields until its turn comes. A field which
+// arrives after its turn needs the full tree.
+inline void json_to_bin_reorderable(pseudo_object*, json_to_bin_state& state, bool allow_extensions,
+                                    const abi_type* type) {
+    auto& stack_entry = state.stack.back();
+    const std::vector<eosio::abi_field>& fields = type->as_struct()->fields;
+    if (stack_entry.value_field == stack_entry.position + 1) {
+        ++stack_entry.position;
+        while (write_early_field(state, stack_entry)) {
+        }
+    } else if (stack_entry.value_field >= 0) {
+        auto depth = state.stack.size();
+        auto it = state.early_fields.end();
+        while (it != state.early_fields.begin() && it[-1].depth == depth && it[-1].field != stack_entry.value_field)
+            --it;
+        if (it == state.early_fields.begin() || it[-1].depth != depth)
+            it = state.early_fields.insert(state.early_fields.end(),
+                                           early_field{depth, stack_entry.value_field, false, {}});
+        else
+            --it;
+        it->bin.assign(state.writer.begin + stack_entry.value_start, state.writer.pos);
+        it->skipped_extension = state.skipped_extension;
+        state.writer.pos = state.writer.begin + stack_entry.value_start;
+        state.skipped_extension = stack_entry.outer_skipped_extension;
+    }
+    stack_entry.value_field = -1;
+
+    if (state.get_end_object_pred()) {
+        while (stack_entry.position + 1 != (ptrdiff_t)fields.size()) {
+            if (write_early_field(state, stack_entry))
+                continue;
+            auto& field = fields[stack_entry.position + 1];
+            if (!field.type->extension_of() || !allow_extensions) {
+                stack_entry.position = -1;
+                eosio::check(false, eosio::convert_json_error(eosio::from_json_error::expected_field));
+            }
+            ++stack_entry.position;
+            state.skipped_extension = true;
+        }
+        if (trace_json_to_bin)
+            printf("%*s}\n", int((state.stack.size() - 1) * 4), "");
+        state.stack.pop_back();
+        return;
+    }
+    auto key = state.get_key();
+    auto it = std::find_if(fields.begin(), fields.end(), [&](auto& field) { return field.name == key; });
+    if (it == fields.end())
+        return skip_json_value(state);
+    int index = it - fields.begin();
+    if (index <= stack_entry.position) {
+        state.needs_dom = true;
+        return;
+    }
+    if (trace_json_to_bin)
+        printf("%*sfield %d/%d: %s%s\n", int(state.stack.size() * 4), "", index, int(fields.size()),
+               std::string{it->name}.c_str(), index == stack_entry.position + 1 ? "" : " (early)");
+    stack_entry.value_field = index;
+    if (index == stack_entry.position + 1) {
+        eosio::check(!state.skipped_extension, eosio::convert_json_error(eosio::from_json_error::unexpected_field));
+    } else {
+        stack_entry.value_start = state.writer.size();
+        stack_entry.outer_skipped_extension = state.skipped_extension;
+        state.skipped_extension = false;
+    }
+    // it stays valid: the field belongs to the abi, not the stack
+    it->type->ser->json_to_bin(state, allow_extensions && &*it == &fields.back(), it->type, true);
 }
 
 inline void json_to_bin(pseudo_object*, json_to_bin_state& state, bool allow_extensions,
@@ -776,6 +888,8 @@ inline void json_to_bin(pseudo_object*, json_to_bin_state& state, bool allow_ext
                    allow_extensions);
         state.stack.push_back({type, allow_extensions});
     }
+    if (state.reorderable)
+        return json_to_bin_reorderable((pseudo_object*)nullptr, state, allow_extensions, type);
     auto& stack_entry = state.stack.back();
     const std::vector<eosio::abi_field>& fields = type->as_struct()->fields;
     if (state.get_end_object_pred()) {
@@ -819,16 +933,21 @@ inline void json_to_bin(pseudo_array*, json_to_bin_state& state, bool, const abi
         if (trace_json_to_bin)
             printf("%*s[\n", int(state.stack.size() * 4), "");
         state.stack.push_back({type, false});
-        state.stack.back().size_insertion_index = state.size_insertions.size();
-        // FIXME: add Stream::tellp or similar.
-        state.size_insertions.push_back({state.writer.data.size()});
+        state.stack.back().size_position = state.writer.size();
+        state.writer.write(char(0));
         return;
     }
     auto& stack_entry = state.stack.back();
     if (state.get_end_array_pred()) {
         if (trace_json_to_bin)
             printf("%*s]\n", int((state.stack.size() - 1) * 4), "");
-        state.size_insertions[stack_entry.size_insertion_index].size = stack_entry.position + 1;
+        char size[5];
+        eosio::fixed_buf_stream size_stream{size, sizeof(size)};
+        eosio::varuint32_to_bin(uint32_t(stack_entry.position + 1), size_stream);
+        auto n = size_stream.pos - size;
+        if (n > 1)
+            state.writer.insert(stack_entry.size_position + 1, n - 1);
+        memcpy(state.writer.begin + stack_entry.size_position, size, n);
         state.stack.pop_back();
         return;
     }
@@ -863,11 +982,10 @@ inline void json_to_bin(pseudo_variant*, json_to_bin_state& state, bool allow_ex
         auto typeName = state.get_string();
         if (trace_json_to_bin)
             printf("%*stype: %.*s\n", int(state.stack.size() * 4), "", (int)typeName.size(), typeName.data());
-        auto it = std::find_if(fields.begin(), fields.end(),
-                               [&](auto& field) { return field.name == typeName; });
-        eosio::check(it != fields.end(),
+        auto* it = stack_entry.type->find_alternative(typeName);
+        eosio::check(it,
             eosio::convert_json_error(eosio::from_json_error::invalid_type_for_variant));
-        stack_entry.variant_type_index = it - fields.begin();
+        stack_entry.variant_type_index = it - fields.data();
         eosio::varuint32_to_bin(stack_entry.variant_type_index, state.writer);
     } else if (stack_entry.position == 1) {
         auto& field = fields[stack_entry.variant_type_index];
@@ -881,13 +999,12 @@ inline void json_to_bin(pseudo_variant*, json_to_bin_state& state, bool allow_ex
 // bin_to_json
 ///////////////////////////////////////////////////////////////////////////////
 
+// Appends the json to writer, using ser instead of the type's program
 template<typename F>
-inline void bin_to_json(eosio::input_stream& bin, const abi_type* type, std::string& dest, F&& f) {
-    // FIXME: Write directly to the string instead of creating an additional buffer
-    std::vector<char> buffer;
-    eosio::vector_stream writer{buffer};
+inline void bin_to_json_virtual(eosio::input_stream& bin, const abi_type* type, bool allow_extensions,
+                                eosio::output_stream& writer, F&& f) {
     bin_to_json_state state{bin, writer};
-    type->ser->bin_to_json(state, true, type, true);
+    type->ser->bin_to_json(state, allow_extensions, type, true);
     while (!state.stack.empty()) {
         f();
         auto& entry = state.stack.back();
@@ -895,7 +1012,6 @@ inline void bin_to_json(eosio::input_stream& bin, const abi_type* type, std::str
         eosio::check(state.stack.size() <= max_stack_size,
             eosio::convert_abi_error(eosio::abi_error::recursion_limit_reached));
     }
-    dest = std::string_view(writer.data.data(), writer.data.size());
 }
 
 inline void bin_to_json(bin_to_json_state& state, bool allow_extensions, const abi_type* type, bool start) {
@@ -936,9 +1052,10 @@ inline void bin_to_json(pseudo_object*, bin_to_json_state& state, bool allow_ext
             state.skipped_extension = true;
             return;
         }
-        if(stack_entry.position != 0) { state.writer.write(','); };
-        to_json(field.name, state.writer);
-        state.writer.write(':');
+        auto key = field.json_key;
+        if (stack_entry.position == 0)
+            key.remove_prefix(1);
+        state.writer.write(key.data(), key.size());
         bin_to_json(state, allow_extensions && &field == &fields.back(), field.type, true);
     } else {
         if (trace_bin_to_json)
@@ -961,7 +1078,7 @@ inline void bin_to_json(pseudo_array*, bin_to_json_state& state, bool, const abi
     if (++stack_entry.position < (ptrdiff_t)stack_entry.array_size) {
         if (trace_bin_to_json)
             printf("%*sitem %d/%d %p %s\n", int(state.stack.size() * 4), "", int(stack_entry.position),
-                   int(stack_entry.array_size), type->array_of()->ser, type->array_of()->name.c_str());
+                   int(stack_entry.array_size), type->array_of()->ser, std::string{type->array_of()->name}.c_str());
         if (stack_entry.position != 0) { state.writer.write(','); }
         return bin_to_json(state, false, type->array_of(), true);
     } else {
@@ -987,8 +1104,8 @@ inline void bin_to_json(pseudo_variant*, bin_to_json_state& state, bool allow_ex
         const std::vector<eosio::abi_field>& fields = *stack_entry.type->as_variant();
         eosio::check(index < fields.size(), eosio::convert_stream_error(eosio::stream_error::bad_variant_index));
         auto& f = fields[index];
-        to_json(f.name, state.writer);
-        state.writer.write(',');
+        // start wrote the key's [
+        state.writer.write(f.json_key.data() + 1, f.json_key.size() - 1);
         // FIXME: allow_extensions should be stack_entry.allow_extensions, so why are we combining them?
         bin_to_json(state, allow_extensions && stack_entry.allow_extensions, f.type, true);
     } else {
@@ -1007,4 +1124,148 @@ auto bin_to_json(T* t, bin_to_json_state& state, bool, const abi_type*, bool sta
     return to_json(v, state.writer);
 }
 
+// Interprets type's bin_to_json_program
+template<typename F>
+inline void bin_to_json_program(eosio::input_stream& bin, const abi_type* type, eosio::output_stream& writer, F&& f) {
+    using op = eosio::bin_to_json_opcode;
+    struct frame {
+        const eosio::bin_to_json_op* pc;
+        bool allow_extensions;
+        uint32_t position;
+        uint32_t size;
+    };
+    // The stack limit counts structs, arrays, and variants, like bin_to_json_state::stack
+    frame stack[max_stack_size + 1];
+    frame* fp = stack;
+    *fp = {type->bin_to_json_program.data(), true, 0, 0};
+    auto* limit = stack + max_stack_size - (type->bin_to_json_program.back().code != op::ret);
+    bin_to_json_state state{bin, writer};
+    while (true) {
+        auto& instr = *fp->pc++;
+        switch (instr.code) {
+        case op::bool_: bin_to_json((bool*)nullptr, state, false, nullptr, true); break;
+        case op::int8: bin_to_json((int8_t*)nullptr, state, false, nullptr, true); break;
+        case op::uint8: bin_to_json((uint8_t*)nullptr, state, false, nullptr, true); break;
+        case op::int16: bin_to_json((int16_t*)nullptr, state, false, nullptr, true); break;
+        case op::uint16: bin_to_json((uint16_t*)nullptr, state, false, nullptr, true); break;
+        case op::int32: bin_to_json((int32_t*)nullptr, state, false, nullptr, true); break;
+        case op::uint32: bin_to_json((uint32_t*)nullptr, state, false, nullptr, true); break;
+        case op::int64: bin_to_json((int64_t*)nullptr, state, false, nullptr, true); break;
+        case op::uint64: bin_to_json((uint64_t*)nullptr, state, false, nullptr, true); break;
+        case op::int128: bin_to_json((int128*)nullptr, state, false, nullptr, true); break;
+        case op::uint128: bin_to_json((uint128*)nullptr, state, false, nullptr, true); break;
+        case op::varuint32: bin_to_json((varuint32*)nullptr, state, false, nullptr, true); break;
+        case op::varint32: bin_to_json((varint32*)nullptr, state, false, nullptr, true); break;
+        case op::float32: bin_to_json((float*)nullptr, state, false, nullptr, true); break;
+        case op::float64: bin_to_json((double*)nullptr, state, false, nullptr, true); break;
+        case op::float128: bin_to_json((float128*)nullptr, state, false, nullptr, true); break;
+        case op::time_point: bin_to_json((time_point*)nullptr, state, false, nullptr, true); break;
+        case op::time_point_sec: bin_to_json((time_point_sec*)nullptr, state, false, nullptr, true); break;
+        case op::block_timestamp: bin_to_json((block_timestamp*)nullptr, state, false, nullptr, true); break;
+        case op::name: bin_to_json((name*)nullptr, state, false, nullptr, true); break;
+        case op::bytes: bin_to_json((bytes*)nullptr, state, false, nullptr, true); break;
+        case op::string: bin_to_json((std::string*)nullptr, state, false, nullptr, true); break;
+        case op::checksum160: bin_to_json((checksum160*)nullptr, state, false, nullptr, true); break;
+        case op::checksum256: bin_to_json((checksum256*)nullptr, state, false, nullptr, true); break;
+        case op::checksum512: bin_to_json((checksum512*)nullptr, state, false, nullptr, true); break;
+        case op::public_key: bin_to_json((public_key*)nullptr, state, false, nullptr, true); break;
+        case op::private_key: bin_to_json((private_key*)nullptr, state, false, nullptr, true); break;
+        case op::signature: bin_to_json((signature*)nullptr, state, false, nullptr, true); break;
+        case op::symbol: bin_to_json((symbol*)nullptr, state, false, nullptr, true); break;
+        case op::symbol_code: bin_to_json((symbol_code*)nullptr, state, false, nullptr, true); break;
+        case op::asset: bin_to_json((asset*)nullptr, state, false, nullptr, true); break;
+        case op::optional: {
+            bool present;
+            from_bin(present, bin);
+            if (!present) {
+                writer.write("null", 4);
+                fp->pc += instr.arg;
+            }
+            break;
+        }
+        case op::call: {
+            bool allow_extensions = fp->allow_extensions && instr.keep_allow_extensions;
+            if (instr.type->bin_to_json_program.empty()) {
+                bin_to_json_virtual(bin, instr.type, allow_extensions, writer, f);
+                break;
+            }
+            f();
+            eosio::check(fp < limit, eosio::convert_abi_error(eosio::abi_error::recursion_limit_reached));
+            *++fp = {instr.type->bin_to_json_program.data(), allow_extensions, 0, 0};
+            break;
+        }
+        case op::begin_object: writer.write('{'); break;
+        case op::first_field:
+        case op::field:
+            if (bin.pos == bin.end && fp->allow_extensions && instr.field->type->extension_of()) {
+                fp->pc += instr.arg;
+                break;
+            }
+            if (instr.code == op::field)
+                writer.write(instr.field->json_key.data(), instr.field->json_key.size());
+            else
+                writer.write(instr.field->json_key.data() + 1, instr.field->json_key.size() - 1);
+            break;
+        case op::end_object:
+            writer.write('}');
+            if (fp-- == stack)
+                return;
+            break;
+        case op::begin_array:
+            varuint32_from_bin(fp->size, bin);
+            writer.write('[');
+            break;
+        case op::array_item:
+            if (fp->position == fp->size)
+                fp->pc = &instr + instr.arg;
+            else if (fp->position++ != 0)
+                writer.write(',');
+            break;
+        case op::end_array:
+            writer.write(']');
+            if (fp-- == stack)
+                return;
+            break;
+        case op::variant: {
+            uint32_t index;
+            varuint32_from_bin(index, bin);
+            eosio::check(index < uint32_t(instr.arg),
+                         eosio::convert_stream_error(eosio::stream_error::bad_variant_index));
+            auto key = (*instr.type->as_variant())[index].json_key;
+            writer.write(key.data(), key.size());
+            fp->pc += index;
+            break;
+        }
+        case op::jump: fp->pc = &instr + instr.arg; break;
+        case op::end_variant:
+            writer.write(']');
+            if (fp-- == stack)
+                return;
+            break;
+        case op::ret:
+            if (fp-- == stack)
+                return;
+            break;
+        }
+    }
+}
+
+// Appends the json to writer
+template<typename F>
+inline void bin_to_json(eosio::input_stream& bin, const abi_type* type, eosio::output_stream& writer, F&& f) {
+    bin.check_available(type->min_bin_size);
+    if (!type->bin_to_json_program.empty())
+        return bin_to_json_program(bin, type, writer, f);
+    bin_to_json_virtual(bin, type, true, writer, f);
+}
+
+template<typename F>
+inline void bin_to_json(eosio::input_stream& bin, const abi_type* type, std::string& dest, F&& f) {
+    dest.clear();
+    dest.reserve(type->estimate_json_size(bin.remaining()));
+    eosio::container_output writer{dest};
+    bin_to_json(bin, type, writer, f);
+    writer.finish();
+}
+
 } // namespace abieos
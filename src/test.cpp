@@ -3,9 +3,15 @@
 #include "eosio/abieos.h"
 #include "abieos.hpp"
 #include "fuzzer.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 inline const bool generate_corpus = false;
@@ -394,6 +400,39 @@ void check_types() {
     abieos_set_abi(context, 8, R"({"version":"eosio::abi/1.0"})");
     abieos_set_abi(context, 8, R"({"version":"eosio::abi/1.1"})");
 
+    // Enough alternatives to grow the variant's index; a repeated name selects the first
+    std::string wide = R"({"version":"eosio::abi/1.1","variants":[{"name":"wide","types":[)";
+    for (auto* t : {"bool", "int8", "uint8", "int16", "uint16", "int32", "uint32", "int64", "uint64", "float32",
+                    "float64", "name", "string", "bytes", "varuint32", "varint32", "checksum256", "symbol"}) {
+        wide += "\"" + std::string(t) + "\",\"" + t + "[]\",";
+    }
+    wide += R"("int8"]}]})";
+    check_context(context, abieos_set_abi(context, 9, wide.c_str()));
+    check_type(context, 9, "wide", R"(["bool",true])");
+    check_type(context, 9, "wide", R"(["symbol[]",["4,EOS"]])");
+    check_type(context, 9, "wide", R"(["varint32",-5])");
+    check_context(context, abieos_json_to_bin(context, 9, "wide", R"(["int8",7])"));
+    if (check_context(context, abieos_get_bin_hex(context)) != std::string("0207"))
+        throw std::runtime_error("wide variant: repeated alternative is not the first");
+    check_error(context, "type is not valid for this variant",
+                [&] { return abieos_json_to_bin(context, 9, "wide", R"(["int8[][]",[]])"); });
+
+    // Field names are escaped once, when the abi is loaded
+    check_context(context, abieos_set_abi(context, 10, R"({"version":"eosio::abi/1.1","structs":[{"name":"odd",)"
+                                                       R"("base":"","fields":[{"name":"a\"b","type":"uint8"},)"
+                                                       R"({"name":"c\\d","type":"uint8"}]}]})"));
+    check_type(context, 10, "odd", R"({"a\"b":1,"c\\d":2})");
+
+    // A variant's tag may be padded to any length up to 5 bytes
+    check_context(context, abieos_set_abi(context, 11, R"({"version":"eosio::abi/1.1","variants":[)"
+                                                       R"({"name":"small","types":["uint8","uint16"]}]})"));
+    if (check_context(context, abieos_hex_to_json(context, 11, "small", "800007")) != std::string(R"(["uint8",7])"))
+        throw std::runtime_error("variant: padded tag");
+    if (check_context(context, abieos_hex_to_json(context, 11, "small", "8180808000FFFF")) !=
+        std::string(R"(["uint16",65535])"))
+        throw std::runtime_error("variant: padded tag");
+    check_error(context, "Extra data", [&] { return abieos_hex_to_json(context, 11, "small", "8180808000FFFF00"); });
+
     check_type(context, 0, "bool", R"(true)");
     check_type(context, 0, "bool", R"(false)");
     check_error(context, "Stream overrun", [&] { return abieos_hex_to_json(context, 0, "bool", ""); });
@@ -676,6 +715,10 @@ void check_types() {
     check_type(context, 0, "asset", R"("0.000 FOO")");
     check_type(context, 0, "asset", R"("1.2345 SYS")");
     check_type(context, 0, "asset", R"("-1.2345 SYS")");
+    check_type(context, 0, "asset", R"("-9223372036854775808 SYS")");
+    check_type(context, 0, "asset", R"("-0.000000000000000001 ABCDEFG")");
+    check_type(context, 0, "symbol", R"("255,A")");
+    check_type(context, 0, "symbol", R"("18,ABCDEFG")");
     check_error(context, "expected string containing asset",
                 [&] { return abieos_json_to_bin(context, 0, "asset", "null"); });
     check_type(context, 0, "asset[]", R"([])");
@@ -711,6 +754,48 @@ void check_types() {
     });
     check_error(context, "json parse error", [&] { return abieos_json_to_bin_reorderable(context, 0, "int8", "1,2"); });
 
+    // Reorderable objects use the last of duplicate keys
+    check_context(context, abieos_json_to_bin(context, 0, "permission_level", R"({"actor":"c","permission":"b"})"));
+    std::string ordered_hex = check_context(context, abieos_get_bin_hex(context));
+    check_context(context, abieos_json_to_bin_reorderable(context, 0, "permission_level",
+                                                          R"({"permission":"b","actor":"a","actor":"c"})"));
+    check(ordered_hex == check_context(context, abieos_get_bin_hex(context)), "duplicate keys");
+
+    // Fields which arrive early are buffered until their turn
+    auto reordered = [&](uint64_t contract, const char* type, const std::string& ordered, const std::string& json) {
+        check_context(context, abieos_json_to_bin(context, contract, type, ordered.c_str()));
+        std::string expected = check_context(context, abieos_get_bin_hex(context));
+        check_context(context, abieos_json_to_bin_reorderable(context, contract, type, json.c_str()));
+        if (expected != check_context(context, abieos_get_bin_hex(context)))
+            throw std::runtime_error("reordered mismatch: " + json);
+    };
+    reordered(testAbiName, "s3", R"({"z1":7,"z2":["int8",6],"z3":{"y1":1,"y2":2}})",
+              R"({"z3":{"y2":2,"y1":1},"z2":["int8",6],"z1":7})");
+    reordered(testAbiName, "s3", R"({"z1":7,"z2":["int8",6],"z3":{"y1":1}})",
+              R"({"z3":{"y1":1},"z1":7,"z2":["int8",6]})");
+    reordered(testAbiName, "s3", R"({"z1":7,"z2":["int8",6]})", R"({"z2":["int8",6],"z1":7})");
+    reordered(testAbiName, "s2", R"({"y1":1,"y2":2})", R"({"unknown":[{"q":1},[]],"y2":5,"y2":2,"y1":1})");
+    check_error(context, "unexpected field", [&] {
+        return abieos_json_to_bin_reorderable(context, testAbiName, "s3", R"({"z3":{"y1":1},"z1":7})");
+    });
+    std::string actions, reversed_actions;
+    for (int i = 0; i < 130; ++i) {
+        actions += std::string(i ? "," : "") +
+                   R"({"account":"eosio.token","name":"transfer","authorization":[{"actor":"alice",)"
+                   R"("permission":"active"}],"data":"0)" +
+                   std::to_string(i % 10) + R"("})";
+        reversed_actions += std::string(i ? "," : "") + R"({"data":"0)" + std::to_string(i % 10) +
+                            R"(","authorization":[{"permission":"active","actor":"alice"}],"name":"transfer",)"
+                            R"("account":"eosio.token"})";
+    }
+    reordered(0, "transaction",
+              R"({"expiration":"2009-02-13T23:31:31.000","ref_block_num":1234,"ref_block_prefix":5678,)"
+              R"("max_net_usage_words":0,"max_cpu_usage_ms":0,"delay_sec":0,"context_free_actions":[],"actions":[)" +
+                  actions + R"(],"transaction_extensions":[]})",
+              R"({"transaction_extensions":[],"actions":[)" + reversed_actions +
+                  R"(],"context_free_actions":[],"delay_sec":0,"max_cpu_usage_ms":0,"max_net_usage_words":0,)"
+                  R"("ref_block_prefix":5678,"ref_block_num":1234,"expiration":"2009-02-13T23:31:31.000"})");
+
     check_error(context, "optional (?) and array ([]) don't support nesting",
                 [&] { return abieos_json_to_bin(context, 0, "int8?[]", ""); });
     check_error(context, "optional (?) and array ([]) don't support nesting",
@@ -928,9 +1013,687 @@ void check_types() {
     abieos_destroy(context);
 }
 
+void check_registry() {
+    auto context = check(abieos_create());
+    auto registry = check(abieos_registry_create());
+    auto token = check_context(context, abieos_string_to_name(context, "eosio.token"));
+    check_context(context, abieos_registry_set_abi_hex(context, registry, token, tokenHexAbi));
+    check_error(context, "contract \"eosio.token\" is not loaded",
+                [&] { return abieos_get_type_for_action(context, token, abieos_string_to_name(context, "transfer")); });
+    check_context(context, abieos_set_registry(context, registry));
+
+    const char transfer[] = R"({"from":"useraaaaaaaa","to":"useraaaaaaab","quantity":"0.0001 SYS","memo":"test memo"})";
+    check_context(context, abieos_json_to_bin(context, token, "transfer", transfer));
+    std::string hex = check_context(context, abieos_get_bin_hex(context));
+
+    std::vector<std::thread> threads;
+    std::vector<std::string> errors(4);
+    for (size_t i = 0; i < errors.size(); ++i) {
+        threads.emplace_back([&, i] {
+            auto thread_context = abieos_create();
+            abieos_set_registry(thread_context, registry);
+            for (int j = 0; j < 200; ++j) {
+                auto json = abieos_hex_to_json(thread_context, token, j & 1 ? "transfer" : "asset[]", hex.c_str());
+                if (j & 1 && (!json || json != std::string(transfer)))
+                    errors[i] = "thread conversion mismatch";
+            }
+            abieos_destroy(thread_context);
+        });
+    }
+    for (int j = 0; j < 20; ++j)
+        check_context(context, abieos_registry_set_abi_hex(context, registry, token, tokenHexAbi));
+    for (auto& t : threads)
+        t.join();
+    for (auto& e : errors)
+        if (!e.empty())
+            throw std::runtime_error(e);
+
+    // Contracts which set identical abis share one
+    auto token2 = check_context(context, abieos_string_to_name(context, "token2"));
+    auto transfer_handle = [&](uint64_t contract) {
+        return check_context(context, abieos_get_type_handle(context, contract, "transfer"));
+    };
+    check_context(context, abieos_registry_set_abi_hex(context, registry, token2, tokenHexAbi));
+    check(transfer_handle(token) == transfer_handle(token2), "identical abis shared");
+    check_context(context, abieos_registry_set_abi(context, registry, token2, transactionAbi));
+    check_error(context, "Unknown type", [&] { return abieos_get_type_handle(context, token2, "transfer"); });
+    check_context(context, abieos_registry_set_abi_hex(context, registry, token2, tokenHexAbi));
+    check(transfer_handle(token) == transfer_handle(token2), "identical abis shared again");
+
+    // Many contracts can be set together; a bad abi sets none of them
+    std::vector<char> token_abi(strlen(tokenHexAbi) / 2);
+    check(eosio::hex_decode(token_abi.data(), tokenHexAbi, strlen(tokenHexAbi)), "token abi hex");
+    std::vector<abieos_abi_item> abi_items;
+    for (int i = 0; i < 100; ++i)
+        abi_items.push_back({0x1000 + uint64_t(i), token_abi.data(), token_abi.size()});
+    abi_items.push_back({0x2000, "\x00", 1});
+    check_error(context, "abi", [&] {
+        return abieos_registry_set_abis_bin(context, registry, abi_items.data(), abi_items.size());
+    });
+    check_error(context, "not loaded", [&] { return abieos_get_type_handle(context, 0x1000, "transfer"); });
+    abi_items.pop_back();
+    check_context(context, abieos_registry_set_abis_bin(context, registry, abi_items.data(), abi_items.size()));
+    for (auto& item : abi_items)
+        check(transfer_handle(item.contract) == transfer_handle(token), "abis set together");
+    check_context(context, abieos_registry_set_abis_bin(context, registry, nullptr, 0));
+    check_error(context, "items is null",
+                [&] { return abieos_registry_set_abis_bin(context, registry, nullptr, 1); });
+
+    abieos_registry_destroy(registry); // attached contexts keep it alive
+    check_context(context, abieos_hex_to_json(context, token, "transfer", hex.c_str()));
+
+    check_context(context, abieos_set_registry(context, nullptr));
+    check_error(context, "contract \"eosio.token\" is not loaded",
+                [&] { return abieos_hex_to_json(context, token, "transfer", hex.c_str()); });
+    abieos_destroy(context);
+}
+
+const char historyAbi1[] = R"({
+    "version": "eosio::abi/1.0",
+    "structs": [
+        {"name": "s1", "base": "", "fields": [{"name": "a", "type": "uint8"}]},
+        {"name": "s2", "base": "", "fields": [{"name": "x", "type": "s1"}]},
+        {"name": "s3", "base": "", "fields": [{"name": "n", "type": "name"}]}
+    ],
+    "actions": [
+        {"name": "act", "type": "s2", "ricardian_contract": ""},
+        {"name": "bad", "type": "s4", "ricardian_contract": ""}
+    ],
+    "tables": [{"name": "rows", "index_type": "i64", "key_names": [], "key_types": [], "type": "s3"}]
+})";
+
+const char historyAbi2[] = R"({
+    "version": "eosio::abi/1.0",
+    "structs": [
+        {"name": "s1", "base": "", "fields": [{"name": "a", "type": "uint16"}]},
+        {"name": "s2", "base": "", "fields": [{"name": "x", "type": "s1"}]},
+        {"name": "s3", "base": "", "fields": [{"name": "n", "type": "name"}]}
+    ],
+    "actions": [{"name": "act", "type": "s2", "ricardian_contract": ""}]
+})";
+
+void check_handles() {
+    auto context = check(abieos_create());
+    auto contract = check_context(context, abieos_string_to_name(context, "history"));
+    check_context(context, abieos_set_abi_at_block(context, contract, 0, historyAbi1));
+    auto s2 = check_context(context, abieos_get_type_handle(context, contract, "s2"));
+    auto s2_array = check_context(context, abieos_get_type_handle(context, contract, "s2[]"));
+    check(s2 == check_context(context, abieos_get_type_handle(context, contract, "s2")), "stable handle");
+    check_error(context, "unknown type \"s4\"", [&] { return abieos_get_type_handle(context, contract, "s4"); });
+    check_error(context, "type is null", [&] { return abieos_json_to_bin_with_handle(context, nullptr, "{}"); });
+
+    check_context(context, abieos_json_to_bin_with_handle(context, s2, R"({"x":{"a":5}})"));
+    check(std::string(check_context(context, abieos_get_bin_hex(context))) == "05", "json_to_bin_with_handle");
+    check_context(context, abieos_json_to_bin_reorderable_with_handle(context, s2_array, R"([{"x":{"a":5}}])"));
+    check(std::string(check_context(context, abieos_get_bin_hex(context))) == "0105", "reorderable_with_handle");
+    check(std::string(check_context(context, abieos_bin_to_json_with_handle(context, s2, "\x07", 1))) ==
+              R"({"x":{"a":7}})",
+          "bin_to_json_with_handle");
+    check_error(context, "Extra data", [&] { return abieos_bin_to_json_with_handle(context, s2, "\x07\x00", 2); });
+
+    auto name = [&](const char* s) { return abieos_string_to_name(context, s); };
+    check(std::string(check_context(context, abieos_action_bin_to_json(context, contract, name("act"), "\x07", 1))) ==
+              R"({"x":{"a":7}})",
+          "action_bin_to_json");
+    check(std::string(check_context(context, abieos_table_bin_to_json(context, contract, name("rows"),
+                                                                      "\0\0\0\0\0\xea\x30\x55", 8))) ==
+              R"({"n":"eosio"})",
+          "table_bin_to_json");
+    check_error(context, "unknown type \"s4\"",
+                [&] { return abieos_action_bin_to_json(context, contract, name("bad"), "", 0); });
+    check_error(context, "contract \"history\" does not have action \"nope\"",
+                [&] { return abieos_action_bin_to_json(context, contract, name("nope"), "", 0); });
+    check_error(context, "contract \"history\" does not have table \"act\"",
+                [&] { return abieos_table_bin_to_json(context, contract, name("act"), "\x07", 1); });
+
+    abieos_bin_item items[] = {
+        {contract, "s2", nullptr, "\x07", 1},
+        {contract, nullptr, s2, "\x07\x00", 2},
+        {contract, "s4", nullptr, "", 0},
+        {0, nullptr, s2_array, "\x02\x01\x02", 3},
+        {name("nope"), "s2", nullptr, "\x07", 1},
+    };
+    size_t offsets[5];
+    abieos_bool ok[5];
+    auto batch = check_context(context, abieos_bin_to_json_batch(context, items, 5, offsets, ok));
+    check(ok[0] && std::string(batch + offsets[0]) == R"({"x":{"a":7}})", "batch 0");
+    check(!ok[1] && std::string(batch + offsets[1]) == "Extra data", "batch 1");
+    check(!ok[2] && std::string(batch + offsets[2]) == "Unknown type", "batch 2");
+    check(ok[3] && std::string(batch + offsets[3]) == R"([{"x":{"a":1}},{"x":{"a":2}}])", "batch 3");
+    check(!ok[4] && std::string(batch + offsets[4]) == "contract \"nope\" is not loaded", "batch 4");
+    check_error(context, "items, offsets, or ok is null",
+                [&] { return abieos_bin_to_json_batch(context, nullptr, 1, offsets, ok); });
+
+    std::vector<abieos_bin_item> many;
+    for (int i = 0; i < 1000; ++i)
+        many.push_back(items[i % 5]);
+    std::vector<size_t> many_offsets(many.size());
+    std::vector<abieos_bool> many_ok(many.size());
+    std::vector<std::string> expected;
+    for (int i = 0; i < 5; ++i)
+        expected.push_back(batch + offsets[i]);
+    auto serial_size = offsets[4] + expected[4].size() + 1;
+    check_context(context, abieos_set_threads(context, 4));
+    for (int j = 0; j < 3; ++j) {
+        auto parallel =
+            check_context(context, abieos_bin_to_json_batch(context, many.data(), many.size(), many_offsets.data(),
+                                                            many_ok.data()));
+        for (size_t i = 0; i < many.size(); ++i) {
+            check(many_ok[i] == ok[i % 5] && many_offsets[i] == i / 5 * serial_size + offsets[i % 5] &&
+                      parallel + many_offsets[i] == expected[i % 5],
+                  "parallel batch");
+        }
+    }
+    check_context(context, abieos_set_threads(context, 1));
+
+    // A throwing item reaches run()'s caller only after every thread is done with the job
+    abieos::thread_pool pool{4};
+    for (size_t failing = 0; failing < pool.size(); ++failing) {
+        std::atomic<size_t> calls = 0;
+        try {
+            pool.run([&](size_t index) {
+                ++calls;
+                std::this_thread::sleep_for(std::chrono::milliseconds(index == failing ? 0 : 5));
+                if (index == failing)
+                    throw std::runtime_error("item failed");
+            });
+            throw std::runtime_error("thread_pool didn't rethrow");
+        } catch (std::runtime_error& e) {
+            check(std::string(e.what()) == "item failed" && calls == pool.size(), "thread_pool error");
+        }
+    }
+    std::atomic<size_t> calls = 0;
+    pool.run([&](size_t) { ++calls; });
+    check(calls == pool.size(), "thread_pool after error");
+
+    char buf[32];
+    size_t result_size = 0;
+    check_context(context, abieos_bin_to_json_buffer(context, s2, "\x07", 1, buf, sizeof(buf), &result_size));
+    check(result_size == 14 && std::string(buf) == R"({"x":{"a":7}})", "bin_to_json_buffer");
+    check_context(context, abieos_bin_to_json_buffer(context, s2, "\x07", 1, buf, 4, &result_size));
+    check(result_size == 14, "bin_to_json_buffer overflow");
+    check_context(context, abieos_bin_to_json_buffer(context, s2, "\x07", 1, nullptr, 0, &result_size));
+    check(result_size == 14, "bin_to_json_buffer size");
+    check_error(context, "Extra data",
+                [&] { return abieos_bin_to_json_buffer(context, s2, "\x07\x00", 2, buf, sizeof(buf), &result_size); });
+    check_context(context, abieos_json_to_bin_buffer(context, s2_array, R"([{"x":{"a":1}},{"x":{"a":2}}])", buf,
+                                                     sizeof(buf), &result_size));
+    check(result_size == 3 && std::string(buf, 3) == "\x02\x01\x02", "json_to_bin_buffer");
+    check_context(context, abieos_json_to_bin_buffer(context, s2_array, R"([{"x":{"a":1}},{"x":{"a":2}}])", buf, 1,
+                                                     &result_size));
+    check(result_size == 3, "json_to_bin_buffer overflow");
+    check_error(context, "type, buf, or result_size is null",
+                [&] { return abieos_json_to_bin_buffer(context, s2, "{}", nullptr, 1, &result_size); });
+
+    // Array sizes which need more than one byte
+    std::string big_json = "[", big_hex = "C801";
+    for (int i = 0; i < 200; ++i) {
+        big_json += std::string(i ? "," : "") + R"({"x":{"a":)" + std::to_string(i % 100) + "}}";
+        uint8_t byte = i % 100;
+        abieos::hex(&byte, &byte + 1, std::back_inserter(big_hex));
+    }
+    big_json += "]";
+    check_context(context, abieos_json_to_bin_with_handle(context, s2_array, big_json.c_str()));
+    check(std::string(check_context(context, abieos_get_bin_hex(context))) == big_hex, "json_to_bin big array");
+    check_context(context, abieos_json_to_bin_buffer(context, s2_array, big_json.c_str(), buf, sizeof(buf),
+                                                     &result_size));
+    check(result_size == 202, "json_to_bin_buffer big array");
+
+    // In situ conversion uses the caller's buffer
+    std::string in_situ = big_json;
+    check_context(context, abieos_json_to_bin_in_situ(context, s2_array, in_situ.data(), in_situ.size()));
+    check(std::string(check_context(context, abieos_get_bin_hex(context))) == big_hex, "json_to_bin_in_situ");
+    in_situ = R"({"x":{"a":5}} )";
+    check_error(context, "json is not NUL-terminated at size",
+                [&] { return abieos_json_to_bin_in_situ(context, s2, in_situ.data(), in_situ.size() - 1); });
+
+    // Handles keep using the abi they came from
+    check_context(context, abieos_set_abi_at_block(context, contract, 0, historyAbi2));
+    check_context(context, abieos_json_to_bin_with_handle(context, s2, R"({"x":{"a":5}})"));
+    check(std::string(check_context(context, abieos_get_bin_hex(context))) == "05", "old handle");
+    auto new_s2 = check_context(context, abieos_get_type_handle(context, contract, "s2"));
+    check_context(context, abieos_json_to_bin_with_handle(context, new_s2, R"({"x":{"a":5}})"));
+    check(std::string(check_context(context, abieos_get_bin_hex(context))) == "0500", "new handle");
+    abieos_destroy(context);
+}
+
+void check_history() {
+    auto context = check(abieos_create());
+    auto contract = check_context(context, abieos_string_to_name(context, "history"));
+    auto act = check_context(context, abieos_string_to_name(context, "act"));
+    auto to_hex = [&](const char* type, const char* json) {
+        check_context(context, abieos_json_to_bin(context, contract, type, json));
+        return std::string(check_context(context, abieos_get_bin_hex(context)));
+    };
+
+    check_context(context, abieos_set_abi_at_block(context, contract, 10, historyAbi1));
+    check_context(context, abieos_set_abi_at_block(context, contract, 100, historyAbi2));
+    check(to_hex("s2", R"({"x":{"a":300}})") == "2C01", "latest abi");
+    check(to_hex("s3", R"({"n":"eosio"})") == "0000000000EA3055", "shared type");
+
+    check_context(context, abieos_set_block_num(context, 99));
+    check(to_hex("s2", R"({"x":{"a":5}})") == "05", "abi at block 99");
+    check_error(context, "number is out of range",
+                [&] { return abieos_json_to_bin(context, contract, "s2", R"({"x":{"a":300}})"); });
+    auto action_type = check_context(context, abieos_get_type_for_action(context, contract, act));
+    auto table_type =
+        check_context(context, abieos_get_type_for_table(context, contract, abieos_string_to_name(context, "rows")));
+    check(to_hex("s3", R"({"n":"eosio"})") == "0000000000EA3055", "conversion between getters");
+    check(std::string(action_type) == "s2" && std::string(table_type) == "s3", "action and table");
+    check_context(context, abieos_set_block_num(context, 100));
+    check(to_hex("s2", R"({"x":{"a":300}})") == "2C01", "abi at block 100");
+    check_context(context, abieos_set_block_num(context, 9));
+    check_error(context, "contract \"history\" is not loaded",
+                [&] { return abieos_json_to_bin(context, contract, "s2", R"({"x":{"a":5}})"); });
+    check_error(context, "contract \"history\" is not loaded",
+                [&] { return abieos_get_type_handle(context, contract, "s2"); });
+
+    // abieos_set_abi doesn't replace block 0's abi; abieos_set_abi_at_block does
+    check_context(context, abieos_set_abi(context, contract, historyAbi1));
+    check_context(context, abieos_set_abi(context, contract, historyAbi2));
+    check(to_hex("s2", R"({"x":{"a":5}})") == "05", "abi at block 0");
+    check_context(context, abieos_set_abi_at_block(context, contract, 0, historyAbi2));
+    check(to_hex("s2", R"({"x":{"a":5}})") == "0500", "replaced abi at block 0");
+    abieos_destroy(context);
+
+    // Unchanged types are shared with the previous version; types which depend on changed types aren't
+    auto load = [](const char* json) {
+        std::string copy{json};
+        eosio::json_token_stream stream(copy.data());
+        return eosio::from_json<eosio::abi_def>(stream);
+    };
+    auto def1 = load(historyAbi1);
+    auto def2 = load(historyAbi2);
+    auto abi1 = std::make_shared<eosio::abi>();
+    convert(def1, *abi1);
+    eosio::abi abi2;
+    convert(def2, abi2, def1, abi1);
+    auto bin_size = [&](const char* type, uint32_t min, uint32_t max) {
+        auto* t = abi2.get_type(type);
+        check(t->bin_size_known && t->min_bin_size == min && t->max_bin_size == max, type);
+    };
+    const auto unbounded = eosio::abi_type::unbounded_bin_size;
+    bin_size("s1", 2, 2);
+    bin_size("s2", 2, 2);
+    bin_size("s3", 8, 8);
+    bin_size("s2?", 1, 3);
+    bin_size("s3[]", 1, unbounded);
+    bin_size("extended_asset", 24, 24);
+    bin_size("varuint32", 1, 5);
+    bin_size("public_key", 34, unbounded);
+    auto estimate = [&](const char* type, size_t bin_size) {
+        return abi2.get_type(type)->estimate_json_size(bin_size);
+    };
+    check(estimate("bytes", 101) == 202 && estimate("string", 101) == 102, "json size estimate");
+    check(estimate("s3[]", 801) > estimate("s3", 8) * 100, "json size estimate of array");
+    check(abi2.get_type("s3") == abi1->get_type("s3"), "s3 shared");
+    check(abi2.get_type("s3[]") != abi1->get_type("s3[]"), "s3[] not shared");
+    check(abi2.get_type("s2") != abi1->get_type("s2"), "s2 not shared");
+    check(abi2.get_type("s1") != abi1->get_type("s1"), "s1 not shared");
+    eosio::abi_def round_trip;
+    convert(abi2, round_trip);
+    check(round_trip.structs.size() == def2.structs.size() && round_trip.types.empty(), "round trip");
+
+    // Lazy abis resolve a type and what it refers to on first use
+    auto lazy_def = std::make_shared<eosio::abi_def>(def2);
+    lazy_def->structs.push_back({"broken", "", {{"b", "s9"}}});
+    lazy_def->types.push_back({"t2", "s2"});
+    eosio::abi lazy;
+    convert_lazy(lazy_def, lazy, def1, abi1);
+    check(lazy.find_type("s2") == nullptr && lazy.find_type("t2") == nullptr, "lazy unresolved");
+    check(lazy.find_type("s3") == abi1->get_type("s3"), "lazy shared");
+    auto* t2 = lazy.get_type("t2");
+    check(t2 == lazy.find_type("s2") && lazy.find_type("s1") && lazy.find_type("t2") == t2, "lazy closure");
+    check(t2->bin_size_known && t2->min_bin_size == 2 && !t2->bin_to_json_program.empty(), "lazy compiled");
+    check(t2->json_to_bin(R"({"x":{"a":300}})") == std::vector<char>{0x2c, 0x01}, "lazy json_to_bin");
+    check(lazy.find_type("s2[]") == nullptr && lazy.get_type("s2[]")->array_of() == t2, "lazy array");
+    bool failed = false;
+    try {
+        lazy.get_type("broken");
+    } catch (std::exception&) {
+        failed = true;
+    }
+    check(failed && lazy.find_type("broken") == nullptr, "lazy error");
+
+    context = check(abieos_create());
+    check_context(context, abieos_set_lazy_abis(context, true));
+    std::string broken_abi = historyAbi1;
+    broken_abi.replace(broken_abi.find(R"("type": "name")"), 14, R"("type": "nope")");
+    check_context(context, abieos_set_abi(context, contract, broken_abi.c_str()));
+    check(to_hex("s2", R"({"x":{"a":5}})") == "05", "lazy context");
+    check_error(context, "Unknown type", [&] { return abieos_json_to_bin(context, contract, "s3", "{}"); });
+    abieos_destroy(context);
+}
+
+void check_images() {
+    auto context = check(abieos_create());
+    auto loaded = check(abieos_create());
+    auto contract = check_context(context, abieos_string_to_name(context, "history"));
+    auto save = [&](abieos_context* c) {
+        check_context(c, abieos_save_abi_image(c, contract));
+        auto* data = check_context(c, abieos_get_bin_data(c));
+        return std::string(data, abieos_get_bin_size(c));
+    };
+    auto round_trip = [&](auto set) {
+        check_context(context, set());
+        auto image = save(context);
+        check_context(loaded, abieos_set_abi_image(loaded, contract, image.data(), image.size()));
+        check(save(loaded) == image, "image round trip");
+    };
+    round_trip([&] { return abieos_set_abi(context, contract, transactionAbi); });
+    round_trip([&] { return abieos_set_abi(context, contract, testAbi); });
+    round_trip([&] { return abieos_set_abi_hex(context, contract, tokenHexAbi); });
+
+    // An image includes the types a version shares with earlier versions
+    check_context(context, abieos_set_abi_at_block(context, contract, 10, historyAbi1));
+    check_context(context, abieos_set_abi_at_block(context, contract, 100, historyAbi2));
+    auto image = save(context);
+    abieos_destroy(loaded);
+    loaded = check(abieos_create());
+    check_context(loaded, abieos_set_abi_image(loaded, contract, image.data(), image.size()));
+    check_context(loaded, abieos_json_to_bin(loaded, contract, "s2[]", R"([{"x":{"a":300}}])"));
+    check(std::string(check_context(loaded, abieos_get_bin_hex(loaded))) == "012C01", "image s2[]");
+    auto act = check_context(loaded, abieos_string_to_name(loaded, "act"));
+    check(std::string(check_context(loaded, abieos_action_bin_to_json(loaded, contract, act, "\x2c\x01", 2))) ==
+              R"({"x":{"a":300}})",
+          "image action");
+    check_error(loaded, "Bad ABI image",
+                [&] { return abieos_set_abi_image(loaded, 1, image.data(), image.size() - 1); });
+    check_error(loaded, "Bad ABI image", [&] { return abieos_set_abi_image(loaded, 1, "", 0); });
+    // An image saved on a machine with the other byte order
+    auto swapped = image;
+    std::reverse(swapped.begin() + 8, swapped.begin() + 12);
+    check_error(loaded, "Bad ABI image",
+                [&] { return abieos_set_abi_image(loaded, 1, swapped.data(), swapped.size()); });
+    abieos_destroy(loaded);
+    abieos_destroy(context);
+}
+
+template <typename Stream>
+std::string json_tokens(std::string json) {
+    std::string result;
+    try {
+        Stream stream(json.data());
+        while (!stream.complete()) {
+            auto& t = stream.peek_token().get();
+            result += std::to_string(int(t.type)) + ":";
+            if (t.type == eosio::json_token_type::type_key)
+                result += std::string(t.key);
+            else if (t.type == eosio::json_token_type::type_string)
+                result += std::string(t.value_string);
+            else if (t.type == eosio::json_token_type::type_bool)
+                result += t.value_bool ? "true" : "false";
+            result += " ";
+            stream.eat_token();
+        }
+        stream.get_end();
+    } catch (std::exception& e) {
+        result += std::string("error: ") + e.what();
+    }
+    return result;
+}
+
+// json_token_stream must produce the same tokens and errors as rapidjson_token_stream
+void check_tokenizer() {
+    auto same = [&](const std::string& json) {
+        auto fast = json_tokens<eosio::json_token_stream>(json);
+        auto reference = json_tokens<eosio::rapidjson_token_stream>(json);
+        if (fast != reference)
+            throw std::runtime_error("tokenizer mismatch on " + json + ": " + fast + " vs " + reference);
+    };
+    std::string long_string(100, 'x');
+    for (auto json : {
+             R"({"from":"alice","to":"bob","quantity":"1.0000 EOS","memo":"a memo"})",
+             R"( [ null , true , false , 0 , -1 , 1.5e3 , -0.25E-2 , {} , [ ] , [[{}]] ] )",
+             "{\n    \"a\": [\n        1,\n        2\n    ],\n    \"b\": {\n        \"c\": \"d\"\n    }\n}\n",
+             R"(["\"\\\/\b\f\n\r\t", "\u0041\u00e9\u4e2d\ud83d\ude00", "caf\u00e9 \u00e9t\u00e9"])",
+             "[\"\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80 mixed with plain text to cross sixteen bytes\"]",
+             "", "   ", "[", "]", "{", "{\"a\"}", "{\"a\":1,}", "{\"a\":1 \"b\":2}", "{1:2}", "[1 2]", "[1,]",
+             "[01]", "[-]", "[1.]", "[1e]", "[1e+]", "[nul]", "[tru]", "[fals]", "1 2", "{} x", "[\"abc",
+             "[\"\\x\"]", "[\"\\u12g4\"]", "[\"\\ud800\"]", "[\"\\ud800\\u0041\"]", "[\"a\tb\"]",
+             "[\"\xc0\xaf\"]", "[\"\xed\xa0\x80\"]", "[\"\xf4\x90\x80\x80\"]", "[\"\xe4\xb8\"]",
+             "[1e308]", "[123456789012345678901234567890]", "[0e400]", "[-0e309]", "[0.0e309]", "[0.0e310]",
+             "[1.5e308]", "[1.5e309]", "[0.000000000000000000001e320]", "[12345678901234567890.5e300]",
+             "[1e-400]", "[-18446744073709551616e288]",
+         })
+        same(json);
+    for (auto digit : {"1", "2"}) {
+        for (auto zeros : {306, 307, 308, 400}) {
+            same("[" + std::string(digit) + std::string(zeros, '0') + "]");
+            same("[-" + std::string(digit) + std::string(zeros, '0') + ".5e-100]");
+        }
+    }
+    same("[\"" + long_string + "\\n" + long_string + "\"]");
+    same("[\"" + long_string + "\"," + std::string(40, ' ') + "\"" + long_string + "\xe2\x82\xac\"]");
+    same(std::string("[\"") + std::string(20, 'y') + std::string(1, '\x01') + "\"]");
+    check(json_tokens<eosio::json_token_stream>("[-1e400]") == "7: error: Number too big to be stored in double",
+          "number too big");
+    same(R"({"actions":[{"account":"eosio.token","name":"transfer","authorization":[{"actor":"alice",)"
+         R"("permission":"active"}],"data":{"from":"alice","to":"bob","quantity":"0.0001 SYS","memo":""}}]})");
+}
+
+template <typename T>
+std::string parse_json_number(const std::string& json) {
+    std::string copy{json};
+    eosio::json_token_stream stream(copy.data());
+    T result;
+    try {
+        eosio::from_json(result, stream);
+    } catch (std::exception& e) {
+        return std::string("error: ") + e.what();
+    }
+    if constexpr (std::is_floating_point_v<T>) {
+        char bits[sizeof(T) * 2 + 1];
+        abieos::hex((const char*)&result, (const char*)&result + sizeof(T), bits);
+        bits[sizeof(T) * 2] = 0;
+        return bits;
+    } else {
+        return std::to_string(result);
+    }
+}
+
+// The old conversion: strtod or strtof on a copy
+template <typename T>
+std::string strtod_number(const std::string& s) {
+    errno = 0;
+    char* end;
+    T result = std::is_same_v<T, float> ? std::strtof(s.c_str(), &end) : std::strtod(s.c_str(), &end);
+    if (s.empty() || errno || end != s.c_str() + s.size())
+        return "error: Expected number or boolean";
+    char bits[sizeof(T) * 2 + 1];
+    abieos::hex((const char*)&result, (const char*)&result + sizeof(T), bits);
+    bits[sizeof(T) * 2] = 0;
+    return bits;
+}
+
+void check_numbers() {
+    auto int_case = [](auto type, const char* s, const std::string& expected) {
+        auto result = parse_json_number<decltype(type)>(std::string("\"") + s + "\"");
+        if (result != expected)
+            throw std::runtime_error(std::string("int mismatch on ") + s + ": " + result);
+    };
+    std::string out_of_range = "error: number is out of range", expected_int = "error: Expected integer";
+    int_case(int8_t{}, "-128", "-128");
+    int_case(int8_t{}, "127", "127");
+    int_case(int8_t{}, "0000000000127", "127");
+    int_case(int8_t{}, "-0", "0");
+    int_case(int8_t{}, "128", out_of_range);
+    int_case(int8_t{}, "-129", out_of_range);
+    int_case(int8_t{}, "1000", out_of_range);
+    int_case(int8_t{}, "12x", expected_int);
+    int_case(int8_t{}, "", expected_int);
+    int_case(int8_t{}, "-", expected_int);
+    int_case(uint8_t{}, "255", "255");
+    int_case(uint8_t{}, "256", out_of_range);
+    int_case(uint8_t{}, "-1", expected_int);
+    int_case(uint64_t{}, "18446744073709551615", "18446744073709551615");
+    int_case(uint64_t{}, "18446744073709551616", out_of_range);
+    int_case(uint64_t{}, "99999999999999999999", out_of_range);
+    int_case(int64_t{}, "-9223372036854775808", "-9223372036854775808");
+    int_case(int64_t{}, "9223372036854775807", "9223372036854775807");
+    int_case(int64_t{}, "9223372036854775808", out_of_range);
+
+    // Floats must match strtod and strtof exactly, including which inputs are errors
+    auto float_case = [](const std::string& s) {
+        auto d = parse_json_number<double>("\"" + s + "\"");
+        auto f = parse_json_number<float>("\"" + s + "\"");
+        if (d != strtod_number<double>(s) || f != strtod_number<float>(s))
+            throw std::runtime_error("float mismatch on " + s + ": " + d + " " + f);
+    };
+    for (auto s : {"0", "-0", "0.0", "1", "-1", "0.1", "1e23", "9007199254740993", "9007199254740992.5",
+                   "1.7976931348623157e308", "1.7976931348623159e308", "2.2250738585072014e-308",
+                   "2.2250738585072011e-308", "4.9e-324", "1e-400", "1e400", "3.4028235e38", "3.4028236e38",
+                   "1.17549435e-38", "1.4e-45", "123456789012345678901234567890", "0.000000000000000000000000001",
+                   "1.", ".5", "+1", "1e", "1e+", " 1", "inf", "nan", "0x10", "1E5", "1e-5", "12345678901234567890",
+                   "1234567890123456789", "7.038531e-26", "1090544144181609348835077142190", "2.4703282292062328e-324"})
+        float_case(s);
+    std::mt19937_64 rng{1};
+    char buf[64];
+    for (int i = 0; i < 100000; ++i) {
+        uint64_t bits = rng();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (!std::isfinite(d))
+            continue;
+        snprintf(buf, sizeof(buf), "%.*g", int(1 + rng() % 17), d);
+        float_case(buf);
+        float f = float(d);
+        snprintf(buf, sizeof(buf), "%.*e", int(rng() % 9), double(f));
+        float_case(buf);
+        snprintf(buf, sizeof(buf), "%.*f", int(rng() % 6), double(uint32_t(bits)) / (1 + rng() % 1000));
+        float_case(buf);
+    }
+}
+
+// The hex kernels must match abieos::hex and abieos::unhex on every length and every bad digit position
+void check_hex() {
+    std::mt19937_64 rng{2};
+    for (size_t size = 0; size < 100; ++size) {
+        std::vector<char> bin(size);
+        for (auto& b : bin)
+            b = char(rng());
+        std::string expected = abieos::hex(bin.begin(), bin.end());
+        std::string encoded(size * 2, 0);
+        eosio::hex_encode(encoded.data(), bin.data(), size);
+        if (encoded != expected)
+            throw std::runtime_error("hex_encode mismatch at size " + std::to_string(size));
+
+        for (size_t i = 0; i < encoded.size(); ++i)
+            if ((rng() & 1) && encoded[i] >= 'A')
+                encoded[i] += 'a' - 'A';
+        std::vector<char> decoded(size);
+        if (!eosio::hex_decode(decoded.data(), encoded.data(), encoded.size()) || decoded != bin)
+            throw std::runtime_error("hex_decode mismatch at size " + std::to_string(size));
+        for (size_t i = 0; i < encoded.size(); ++i) {
+            for (char c : {'/', ':', '@', 'G', '`', 'g', ' ', '\0', '\x80', '\xc1', '\xe6'}) {
+                std::string bad = encoded;
+                bad[i] = c;
+                if (eosio::hex_decode(decoded.data(), bad.data(), bad.size()))
+                    throw std::runtime_error("hex_decode accepted bad digit at " + std::to_string(i));
+            }
+        }
+        if (size && eosio::hex_decode(decoded.data(), encoded.data(), encoded.size() - 1))
+            throw std::runtime_error("hex_decode accepted odd size");
+    }
+}
+
+// to_json(std::string_view) as it was before its ascii fast path
+std::string reference_string_to_json(std::string_view sv) {
+    std::string result = "\"";
+    auto begin = sv.begin();
+    auto end = sv.end();
+    while (begin != end) {
+        auto pos = begin;
+        while (pos != end && *pos != '"' && *pos != '\\' && (unsigned char)(*pos) >= 32 && *pos != 127)
+            ++pos;
+        while (begin != pos) {
+            eosio::stream_adaptor s2(begin, static_cast<std::size_t>(pos - begin));
+            if (rapidjson::UTF8<>::Validate(s2, s2)) {
+                result.append(begin, s2.idx);
+                begin += s2.idx;
+            } else {
+                ++begin;
+                result += '?';
+            }
+        }
+        if (begin != end) {
+            if (*begin == '"') {
+                result += "\\\"";
+            } else if (*begin == '\\') {
+                result += "\\\\";
+            } else {
+                result += "\\u00";
+                result += eosio::hex_digits[(unsigned char)(*begin) >> 4];
+                result += eosio::hex_digits[(unsigned char)(*begin) & 15];
+            }
+            ++begin;
+        }
+    }
+    return result + "\"";
+}
+
+// Strings convert exactly as before, including where invalid utf-8 becomes ?
+void check_strings() {
+    const char* pieces[] = {"a", "memo ", "0123456789abcdef", "\"", "\\", "\n", "\x01", "\x7f", "\xc3\xa9",
+                            "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xc3", "\xe2\x82", "\xf0\x9f\x98", "\x80", "\xbf",
+                            "\xc0\x80", "\xed\xa0\x80", "\xef\xbf\xbf", "\xf4\x90\x80\x80", "\xff", "\0"};
+    std::mt19937_64 rng{3};
+    for (int i = 0; i < 20000; ++i) {
+        std::string s;
+        for (int n = rng() % 40; n; --n) {
+            auto piece = rng() % std::size(pieces);
+            s.append(pieces[piece], piece == std::size(pieces) - 1 ? 1 : strlen(pieces[piece]));
+        }
+        std::string result;
+        eosio::container_output writer{result};
+        eosio::to_json(std::string_view{s}, writer);
+        writer.finish();
+        if (result != reference_string_to_json(s))
+            throw std::runtime_error("string mismatch: " + result + " " + reference_string_to_json(s));
+    }
+}
+
+// A context's result buffers keep their capacity, but a small conversion after a large one stays
+// as cheap as before it
+void check_output_reuse() {
+    std::string retained;
+    retained.reserve(1 << 20);
+    eosio::container_output writer{retained};
+    check(retained.size() < 1024, "container_output exposes old capacity");
+    writer.write("x", 1);
+    writer.finish();
+    check(retained == "x", "container_output reuse");
+
+    auto context = check(abieos_create());
+    check_context(context, abieos_set_abi(context, 0, transactionAbi));
+    auto small_calls = [&] {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 1000; ++i)
+            check(std::string(check_context(context, abieos_hex_to_json(context, 0, "uint8", "07"))) == "7",
+                  "small conversion");
+        return std::chrono::steady_clock::now() - start;
+    };
+    auto before = small_calls();
+    std::string big = "80ade204" + std::string(20'000'000, '4');
+    check_context(context, abieos_hex_to_json(context, 0, "bytes", big.c_str()));
+    check_context(context, abieos_json_to_bin(context, 0, "bytes", ('"' + big.substr(8) + '"').c_str()));
+    auto after = small_calls();
+    check(after < before * 20 + std::chrono::milliseconds(20), "small conversion after a large one is slow");
+    abieos_destroy(context);
+}
+
 int main() {
     try {
         check_types();
+        check_registry();
+        check_history();
+        check_handles();
+        check_images();
+        check_tokenizer();
+        check_numbers();
+        check_hex();
+        check_strings();
+        check_output_reuse();
         printf("\nok\n\n");
         return 0;
     } catch (std::exception& e) {
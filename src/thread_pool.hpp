@@ -0,0 +1,112 @@
+// copyright defined in abieos/LICENSE.txt
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace abieos {
+
+// Threads which help the calling thread run a job
+class thread_pool {
+  public:
+    // num_threads includes the calling thread
+    explicit thread_pool(size_t num_threads) {
+        try {
+            for (size_t i = 1; i < num_threads; ++i)
+                threads.emplace_back([this, i] { work(i); });
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool() { stop(); }
+
+    size_t size() const { return threads.size() + 1; }
+
+    // Calls f(i) for each i in [0, size()), each on a different thread. The calling thread runs
+    // f(0). Returns once every call has returned, even if some threw; then rethrows the first
+    // exception a helper thread caught, unless f(0) itself threw.
+    void run(const std::function<void(size_t)>& f) {
+        {
+            std::lock_guard lock{mutex};
+            job = &f;
+            ++generation;
+            pending = threads.size();
+            error = nullptr;
+        }
+        start_cv.notify_all();
+        {
+            // Helpers still reference f; wait for them before unwinding
+            struct wait_for_helpers {
+                thread_pool& pool;
+                ~wait_for_helpers() {
+                    std::unique_lock lock{pool.mutex};
+                    pool.done_cv.wait(lock, [&] { return pool.pending == 0; });
+                    pool.job = nullptr;
+                }
+            } guard{*this};
+            f(0);
+        }
+        if (error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+    }
+
+  private:
+    void stop() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        start_cv.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    void work(size_t index) {
+        uint64_t seen = 0;
+        while (true) {
+            const std::function<void(size_t)>* f;
+            {
+                std::unique_lock lock{mutex};
+                start_cv.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                f = job;
+            }
+            std::exception_ptr e;
+            try {
+                (*f)(index);
+            } catch (...) {
+                e = std::current_exception();
+            }
+            std::lock_guard lock{mutex};
+            if (e && !error)
+                error = e;
+            if (--pending == 0)
+                done_cv.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads{};
+    std::mutex mutex{};
+    std::condition_variable start_cv{};
+    std::condition_variable done_cv{};
+    const std::function<void(size_t)>* job = nullptr;
+    uint64_t generation = 0;
+    size_t pending = 0;
+    std::exception_ptr error{};
+    bool stopping = false;
+};
+
+} // namespace abieos
@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstdio>
+#include <eosio/from_json.hpp>
+#include <string>
+#include <vector>
+
+// Compares json_token_stream against rapidjson_token_stream on typical action payloads
+
+struct payload {
+   const char* name;
+   std::string json;
+};
+
+std::vector<payload> payloads() {
+   std::vector<payload> result;
+   result.push_back({ "transfer", R"({"from":"alice","to":"bob","quantity":"1.0000 EOS","memo":"payment for services"})" });
+   result.push_back({ "newaccount",
+                      R"({"creator":"eosio","name":"alice","owner":{"threshold":1,"keys":[{"key":)"
+                      R"("EOS6MRyAjQq8ud7hVNYcfnVPJqcVpscN5So8BhtHuGYqET5GDW5CV","weight":1}],"accounts":[],)"
+                      R"("waits":[]},"active":{"threshold":1,"keys":[{"key":)"
+                      R"("EOS6MRyAjQq8ud7hVNYcfnVPJqcVpscN5So8BhtHuGYqET5GDW5CV","weight":1}],"accounts":[{)"
+                      R"("permission":{"actor":"bob","permission":"active"},"weight":1}],"waits":[]}})" });
+
+   std::string code;
+   for (int i = 0; i < 64 * 1024; ++i)
+      code += "0123456789abcdef"[(i * 7) & 15];
+   result.push_back({ "setcode", R"({"account":"alice","vmtype":0,"vmversion":0,"code":")" + code + "\"}" });
+
+   std::string batch = "[\n";
+   for (int i = 0; i < 200; ++i) {
+      if (i)
+         batch += ",\n";
+      batch += "    {\n"
+               "        \"from\": \"alice\",\n"
+               "        \"to\": \"bob" +
+               std::to_string(i) +
+               "\",\n"
+               "        \"quantity\": \"" +
+               std::to_string(i) +
+               ".0000 EOS\",\n"
+               "        \"memo\": \"caf\\u00e9 \\\"order\\\" #" +
+               std::to_string(i) +
+               "\"\n"
+               "    }";
+   }
+   batch += "\n]\n";
+   result.push_back({ "pretty batch", batch });
+   return result;
+}
+
+template <typename Stream>
+size_t count_tokens(std::string& copy, const std::string& json) {
+   copy.assign(json);
+   Stream stream(copy.data());
+   size_t n = 0;
+   while (!stream.complete()) {
+      stream.peek_token();
+      stream.eat_token();
+      ++n;
+   }
+   return n;
+}
+
+template <typename Stream>
+double bench(const std::string& json, size_t& tokens) {
+   std::string copy;
+   size_t      iterations = 1 + (64 << 20) / json.size();
+   auto        start      = std::chrono::steady_clock::now();
+   for (size_t i = 0; i < iterations; ++i)
+      tokens = count_tokens<Stream>(copy, json);
+   std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   return json.size() * double(iterations) / elapsed.count() / (1 << 20);
+}
+
+int main() {
+   try {
+      printf("%-14s %10s %8s %14s %14s %8s\n", "payload", "bytes", "tokens", "rapidjson MB/s", "tokenizer MB/s",
+             "speedup");
+      for (auto& p : payloads()) {
+         size_t reference_tokens = 0, tokens = 0;
+         auto   reference        = bench<eosio::rapidjson_token_stream>(p.json, reference_tokens);
+         auto   fast             = bench<eosio::json_token_stream>(p.json, tokens);
+         if (tokens != reference_tokens) {
+            fprintf(stderr, "%s: token counts differ\n", p.name);
+            return 1;
+         }
+         printf("%-14s %10zu %8zu %14.1f %14.1f %7.2fx\n", p.name, p.json.size(), tokens, reference, fast,
+                fast / reference);
+      }
+   } catch (std::exception& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+   }
+   return 0;
+}